@@ -0,0 +1,36 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/** Benchmarks for the claims of optimizations, built with
+    -DBUILDHL_BENCHMARKS=ON. Numbers depend on the machine, compare the
+    two paths of a run rather than runs on different machines.
+*/
+namespace buildhl_bench {
+    typedef std::vector<std::string> Args;
+
+    /** Runs function count times and prints the fastest and the median
+        run.
+        @return the median in seconds
+    */
+    double measure(const std::string& name, int count, const std::function<void()>& function);
+    /** a new empty directory under the temp directory */
+    std::string scratch_dir(const std::string& name);
+    /** @return args[index] as a number or fallback if not given */
+    double arg_number(const Args& args, size_t index, double fallback);
+
+    /** cmake --build against running the build tool directly on an up to
+        date build dir
+    */
+    int noop_build(const Args& args);
+    /** processes started and waited for per second, with a cwd */
+    int spawn(const Args& args);
+    /** reading a child's output whole, to memory or to a file */
+    int capture(const Args& args);
+    /** jobs that each grow to a lot of memory with and without the
+        jobserver holding tokens back
+    */
+    int jobserver(const Args& args);
+}
@@ -0,0 +1,78 @@
+#include "bench.hpp"
+
+#include <iostream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <subprocess.hpp>
+
+namespace buildhl_bench {
+    namespace {
+        /** how pipe_read_all read before, 2 KiB at a time appended */
+        std::string read_in_small_blocks(subprocess::PipeHandle handle) {
+            char buffer[2048];
+            std::string result;
+            while (true) {
+                ssize_t transfered = subprocess::pipe_read(handle, buffer, sizeof(buffer));
+                if (transfered <= 0)
+                    break;
+                result.insert(result.end(), buffer, buffer + transfered);
+            }
+            return result;
+        }
+
+        /** times reading size bytes of a child's output with read */
+        void measure_read(const std::string& name, int runs, size_t size,
+                const std::function<size_t(subprocess::PipeHandle)>& read) {
+            measure(name, runs, [&]() {
+                auto popen = subprocess::RunBuilder({"head", "-c", std::to_string(size), "/dev/zero"})
+                    .cout(subprocess::PipeOption::pipe).popen();
+                if (read(popen.cout) != size)
+                    std::cout << name << " read the wrong size\n";
+                popen.close();
+            });
+        }
+    }
+
+    int capture(const Args& args) {
+        size_t size = (size_t)(arg_number(args, 0, 100)*1024*1024);
+        int runs    = (int)arg_number(args, 1, 5);
+        std::cout << "capturing " << size/(1024*1024) << " MiB of a child's output\n";
+        measure_read("2 KiB reads appended", runs, size, [](subprocess::PipeHandle handle) {
+            return read_in_small_blocks(handle).size();
+        });
+        measure_read("pipe_read_all", runs, size, [](subprocess::PipeHandle handle) {
+            return subprocess::pipe_read_all(handle).size();
+        });
+        measure_read("pipe_read_all with size_hint", runs, size, [size](subprocess::PipeHandle handle) {
+            return subprocess::pipe_read_all(handle, size).size();
+        });
+        measure("run()", runs, [&]() {
+            subprocess::RunBuilder({"head", "-c", std::to_string(size), "/dev/zero"})
+                .cout(subprocess::PipeOption::pipe).run();
+        });
+#ifndef _WIN32
+        // to a file, through memory or spliced
+        std::string path = scratch_dir("capture") + "/output";
+        auto to_file = [&](const std::function<size_t(subprocess::PipeHandle, int)>& copy) {
+            return [&, copy](subprocess::PipeHandle handle) {
+                int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                size_t copied = copy(handle, fd);
+                ::close(fd);
+                return copied;
+            };
+        };
+        measure_read("pipe_read_all then write", runs, size, to_file([](subprocess::PipeHandle handle, int fd) {
+            std::string data = subprocess::pipe_read_all(handle);
+            return ::write(fd, data.data(), data.size()) == (ssize_t)data.size()? data.size() : 0;
+        }));
+        measure_read("pipe_splice_all", runs, size, to_file([](subprocess::PipeHandle handle, int fd) {
+            return (size_t)subprocess::pipe_splice_all(handle, fd);
+        }));
+#endif
+        return 0;
+    }
+}
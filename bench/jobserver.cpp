@@ -0,0 +1,138 @@
+#include "bench.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include <buildhl/JobServer.hpp>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace buildhl_bench {
+#ifdef _WIN32
+    int jobserver(const Args&) {
+        printf("the jobserver isn't available on windows\n");
+        return 1;
+    }
+#else
+    namespace {
+        /** a build of memory hungry jobs, like links or big translation units */
+        struct HogBuild {
+            int                     tasks;
+            int64_t                 job_memory;
+            std::atomic<int>        next{0};
+            std::atomic<int>        running{0};
+            std::atomic<int>        peak_running{0};
+            std::atomic<int64_t>    in_use{0};
+            std::atomic<int64_t>    peak_in_use{0};
+
+            static void raise(std::atomic<int64_t>& peak, int64_t value) {
+                int64_t old = peak;
+                while (value > old && !peak.compare_exchange_weak(old, value)) {}
+            }
+
+            /** grows to job_memory over 400ms, touching every page */
+            void job() {
+                int now = ++running;
+                int old = peak_running;
+                while (now > old && !peak_running.compare_exchange_weak(old, now)) {}
+                constexpr int kSteps = 8;
+                std::vector<char*> chunks;
+                for (int i = 0; i < kSteps; ++i) {
+                    char* chunk = (char*)malloc(job_memory/kSteps);
+                    memset(chunk, 1, job_memory/kSteps);
+                    chunks.push_back(chunk);
+                    raise(peak_in_use, in_use += job_memory/kSteps);
+                    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+                for (char* chunk : chunks)
+                    free(chunk);
+                in_use -= job_memory;
+                --running;
+            }
+
+            /** make's side of the protocol, fd -1 runs without tokens */
+            void worker(int fd, bool implicit_token) {
+                while (next < tasks) {
+                    if (!implicit_token && fd >= 0) {
+                        struct pollfd poll_fd = {fd, POLLIN, 0};
+                        char token;
+                        if (::poll(&poll_fd, 1, 50) <= 0 || read(fd, &token, 1) != 1)
+                            continue;
+                        if (next++ < tasks)
+                            job();
+                        token = '+';
+                        if (write(fd, &token, 1) != 1)
+                            return;
+                        continue;
+                    }
+                    if (next++ < tasks)
+                        job();
+                }
+            }
+
+            void run(int jobs, int fd) {
+                std::vector<std::thread> workers;
+                for (int i = 0; i < jobs; ++i)
+                    workers.emplace_back([this, fd, i]() { worker(fd, i == 0); });
+                for (auto& worker : workers)
+                    worker.join();
+            }
+        };
+    }
+
+    int jobserver(const Args& args) {
+        int jobs            = (int)arg_number(args, 0, 8);
+        int tasks           = (int)arg_number(args, 1, 24);
+        int64_t job_memory  = (int64_t)arg_number(args, 2, 32)*1024*1024;
+        // the memory of the pretend machine, in jobs
+        double fits         = arg_number(args, 3, 3);
+        int64_t memory      = fits*job_memory;
+        printf("%d jobs of %d MiB with memory for %.1f of them\n", tasks,
+            (int)(job_memory/1024/1024), fits);
+
+        auto report = [&](HogBuild& build) {
+            printf("%-32s at most %d jobs at once, peak %d MiB of %d MiB\n", "",
+                build.peak_running.load(), (int)(build.peak_in_use/1024/1024), (int)(memory/1024/1024));
+        };
+
+        HogBuild unthrottled;
+        unthrottled.tasks       = tasks;
+        unthrottled.job_memory  = job_memory;
+        measure("-j" + std::to_string(jobs), 1, [&]() { unthrottled.run(jobs, -1); });
+        report(unthrottled);
+
+        std::string fifo = scratch_dir("jobserver") + "/fifo";
+        buildhl::JobServer server(jobs, job_memory);
+        HogBuild throttled;
+        throttled.tasks         = tasks;
+        throttled.job_memory    = job_memory;
+        // what MemAvailable would say on the pretend machine
+        server.set_sampler([&]() {
+            buildhl::JobServer::Sample sample;
+            sample.available_memory = std::max<int64_t>(memory - throttled.in_use, 0);
+            sample.cpus             = jobs;
+            return sample;
+        });
+        if (!server.start(fifo)) {
+            printf("could not start the jobserver at %s\n", fifo.c_str());
+            return 1;
+        }
+        int fd = ::open(fifo.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        measure("-j" + std::to_string(jobs) + " with the jobserver", 1, [&]() { throttled.run(jobs, fd); });
+        report(throttled);
+        ::close(fd);
+        server.stop();
+        printf("%s\n", server.summary().c_str());
+        return 0;
+    }
+#endif
+}
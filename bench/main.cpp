@@ -0,0 +1,64 @@
+#include "bench.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <map>
+
+#include <subprocess.hpp>
+
+namespace fs = std::filesystem;
+
+namespace buildhl_bench {
+    double measure(const std::string& name, int count, const std::function<void()>& function) {
+        std::vector<double> seconds;
+        for (int i = 0; i < count; ++i) {
+            subprocess::StopWatch watch;
+            function();
+            seconds.push_back(watch.seconds());
+        }
+        std::sort(seconds.begin(), seconds.end());
+        double median = seconds[seconds.size()/2];
+        printf("%-32s min %9.3f ms  median %9.3f ms  (%d runs)\n", name.c_str(),
+            seconds.front()*1000, median*1000, count);
+        return median;
+    }
+
+    std::string scratch_dir(const std::string& name) {
+        fs::path dir = fs::temp_directory_path() / ("buildhl_bench_" + name);
+        fs::remove_all(dir);
+        fs::create_directories(dir);
+        return dir.string();
+    }
+
+    double arg_number(const Args& args, size_t index, double fallback) {
+        return index < args.size()? std::stod(args[index]) : fallback;
+    }
+}
+
+int main(int argc, char** argv) {
+    using namespace buildhl_bench;
+    struct Benchmark {
+        int (*function)(const Args&);
+        const char* args;
+        const char* description;
+    };
+    const std::map<std::string, Benchmark> benchmarks = {
+        {"capture", {capture, "[MiB] [runs]", "capturing a child's output with pipe_read_all and splice"}},
+        {"jobserver", {jobserver, "[jobs] [tasks] [MiB] [fits]", "memory hungry jobs held back by the jobserver"}},
+        {"noop-build", {noop_build, "[runs] [sources]", "no-op build through cmake --build and directly"}},
+        {"spawn", {spawn, "[threads] [spawns]", "spawn throughput with the child's cwd set"}},
+    };
+    Args args(argv + std::min(argc, 2), argv + argc);
+    auto it = argc > 1? benchmarks.find(argv[1]) : benchmarks.end();
+    if (it == benchmarks.end()) {
+        std::cout << "usage: buildhl_bench <benchmark> [args]\n";
+        for (auto& benchmark : benchmarks) {
+            printf("    %-12s %-20s %s\n", benchmark.first.c_str(), benchmark.second.args,
+                benchmark.second.description);
+        }
+        return 1;
+    }
+    return it->second.function(args);
+}
@@ -0,0 +1,48 @@
+#include "bench.hpp"
+
+#include <fstream>
+#include <iostream>
+
+#include <buildhl/CMakeCacheView.hpp>
+#include <subprocess.hpp>
+
+namespace buildhl_bench {
+    int noop_build(const Args& args) {
+        int runs        = (int)arg_number(args, 0, 20);
+        int sources     = (int)arg_number(args, 1, 50);
+        std::string dir = scratch_dir("noop_build");
+        std::string build_dir = dir + "/build";
+
+        std::ofstream cmake_lists(dir + "/CMakeLists.txt");
+        cmake_lists << "cmake_minimum_required(VERSION 3.6)\nproject(noop C)\nadd_executable(noop";
+        for (int i = 0; i < sources; ++i) {
+            std::string name = "s" + std::to_string(i) + ".c";
+            std::ofstream(dir + "/" + name) << "int f" << i << "(void) { return " << i << "; }\n";
+            cmake_lists << " " << name;
+        }
+        std::ofstream(dir + "/main.c") << "int main(void) { return 0; }\n";
+        cmake_lists << " main.c)\n";
+        cmake_lists.close();
+
+        std::string generator = subprocess::find_program("ninja").empty()? "Unix Makefiles" : "Ninja";
+        auto quiet = [](subprocess::CommandLine command) {
+            subprocess::RunBuilder(command).cout(subprocess::PipeOption::pipe)
+                .cerr(subprocess::PipeOption::pipe).check(true).run();
+        };
+        quiet({"cmake", "-S", dir, "-B", build_dir, "-G", generator, "-DCMAKE_BUILD_TYPE=Release"});
+        quiet({"cmake", "--build", build_dir});
+
+        buildhl::CMakeCacheView cache(build_dir + "/CMakeCache.txt");
+        std::string make_program(cache.get("CMAKE_MAKE_PROGRAM"));
+        std::cout << generator << " build of " << sources << " sources, up to date\n";
+        double wrapped = measure("cmake --build", runs, [&]() {
+            quiet({"cmake", "--build", build_dir});
+        });
+        double direct = measure(make_program + " -C", runs, [&]() {
+            quiet({make_program, "-C", build_dir});
+        });
+        printf("direct saves %.1f ms (%.0f%%) per no-op build\n", (wrapped - direct)*1000,
+            100*(wrapped - direct)/wrapped);
+        return 0;
+    }
+}
@@ -0,0 +1,44 @@
+#include "bench.hpp"
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+#include <subprocess.hpp>
+
+namespace buildhl_bench {
+    int spawn(const Args& args) {
+        int threads = (int)arg_number(args, 0, 4);
+        int spawns  = (int)arg_number(args, 1, 250);
+        std::string cwd = scratch_dir("spawn");
+        std::string before = subprocess::getcwd();
+
+        // the parent's cwd must stay put while children get their own
+        std::atomic<bool> done{false};
+        std::atomic<int> cwd_changes{0};
+        std::thread watcher([&]() {
+            while (!done) {
+                if (subprocess::getcwd() != before)
+                    ++cwd_changes;
+                std::this_thread::yield();
+            }
+        });
+        double seconds = measure(std::to_string(threads) + " threads x " + std::to_string(spawns)
+                + " spawns", 1, [&]() {
+            std::vector<std::thread> workers;
+            for (int i = 0; i < threads; ++i) {
+                workers.emplace_back([&]() {
+                    for (int j = 0; j < spawns; ++j)
+                        subprocess::RunBuilder({"true"}).cwd(cwd).run();
+                });
+            }
+            for (auto& worker : workers)
+                worker.join();
+        });
+        done = true;
+        watcher.join();
+        printf("%.0f spawns/s, the parent's cwd was seen changed %d times\n",
+            threads*spawns/seconds, cwd_changes.load());
+        return 0;
+    }
+}
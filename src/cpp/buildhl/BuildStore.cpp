@@ -0,0 +1,49 @@
+#include "BuildStore.hpp"
+
+#include <teaport_utils/fileutils.hpp>
+
+namespace buildhl {
+    bool BuildStore::open(const std::string& build_dir) {
+        m_strings.reset();
+        m_db.close();
+        std::string dir = tea::join_path(build_dir, "buildhl");
+        try {
+            tea::mkdir_p(dir);
+        } catch (...) {
+            return false;
+        }
+        if (m_db.open(tea::join_path(dir, "buildhl.sqlite")) != SQLITE_OK) {
+            m_db.close();
+            return false;
+        }
+        // parallel buildhl runs on the same build dir wait for each other
+        sqlite3_busy_timeout(m_db.get(), 5000);
+        try {
+            m_strings = std::make_unique<tea::StringCache>(csd::Sqlite3Disowned(m_db));
+        } catch (std::exception&) {
+            m_db.close();
+            return false;
+        }
+        return true;
+    }
+
+    std::string BuildStore::get(const std::string& key) {
+        if (m_strings == nullptr)
+            return {};
+        try {
+            return m_strings->get(key);
+        } catch (std::exception&) {
+            return {};
+        }
+    }
+
+    void BuildStore::set(const std::string& key, const std::string& value) {
+        if (m_strings == nullptr)
+            return;
+        try {
+            m_strings->set(key, value);
+        } catch (std::exception&) {
+            // it's only a cache
+        }
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <teaport_utils/StringCache.hpp>
+
+namespace buildhl {
+    /** buildhl's own data about a build dir, <build>/buildhl/buildhl.sqlite
+
+        Things learned from previous builds live here, keyed by a name
+        owned by whoever stores it.
+    */
+    class BuildStore {
+    public:
+        BuildStore(){}
+        BuildStore(const BuildStore&)=delete;
+        BuildStore& operator=(const BuildStore&)=delete;
+
+        /** creates the database if needed, false if it can't be opened */
+        bool open(const std::string& build_dir);
+        bool is_open() const { return m_db.is_open(); }
+
+        /** @return the value or empty if not set or not open */
+        std::string get(const std::string& key);
+        void set(const std::string& key, const std::string& value);
+
+        /** for tables of your own */
+        csd::Sqlite3& db() { return m_db; }
+    private:
+        csd::Sqlite3                        m_db;
+        std::unique_ptr<tea::StringCache>   m_strings;
+    };
+}
@@ -0,0 +1,106 @@
+#include "CMakeCacheView.hpp"
+
+#include <algorithm>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace buildhl {
+    namespace {
+        int64_t file_mtime(const std::string& path) {
+            std::error_code ec;
+            auto mtime = fs::last_write_time(path, ec);
+            return ec? 0 : mtime.time_since_epoch().count();
+        }
+    }
+
+    bool CMakeCacheView::load(const std::string& path) {
+        m_path  = path;
+        m_mtime = file_mtime(path);
+        m_entries.clear();
+        if (!m_file.open(path)) {
+            m_mtime = 0;
+            return false;
+        }
+        parse();
+        return true;
+    }
+
+    bool CMakeCacheView::reload_if_changed() {
+        if (m_path.empty())
+            return false;
+        if (file_mtime(m_path) == m_mtime)
+            return (bool)m_file;
+        return load(m_path);
+    }
+
+    /*  Lines look like
+
+            // comment
+            # comment
+            NAME:TYPE=VALUE
+            "NAME WITH:SPECIAL=CHARS":TYPE=VALUE
+
+        the value runs to the end of the line and may contain '='.
+    */
+    void CMakeCacheView::parse() {
+        std::string_view data = m_file.view();
+        while (!data.empty()) {
+            size_t end = data.find('\n');
+            std::string_view line = data.substr(0, end);
+            data.remove_prefix(end == std::string_view::npos? data.size() : end + 1);
+            if (!line.empty() && line.back() == '\r')
+                line.remove_suffix(1);
+            if (line.empty() || line[0] == '#' || line[0] == '/')
+                continue;
+
+            Entry entry;
+            size_t name_end;
+            if (line[0] == '"') {
+                size_t quote = line.find('"', 1);
+                if (quote == std::string_view::npos)
+                    continue;
+                entry.name = line.substr(1, quote - 1);
+                name_end = quote + 1;
+            } else {
+                name_end = line.find_first_of(":=");
+                if (name_end == std::string_view::npos)
+                    continue;
+                entry.name = line.substr(0, name_end);
+            }
+            size_t equal = line.find('=', name_end);
+            if (equal == std::string_view::npos)
+                continue;
+            if (name_end < line.size() && line[name_end] == ':')
+                entry.type = line.substr(name_end + 1, equal - name_end - 1);
+            entry.value = line.substr(equal + 1);
+            m_entries.push_back(entry);
+        }
+        // the last definition of a name wins, like in cmake
+        std::stable_sort(m_entries.begin(), m_entries.end(), [](const Entry& a, const Entry& b) {
+            return a.name < b.name;
+        });
+        auto last = std::unique(m_entries.rbegin(), m_entries.rend(), [](const Entry& a, const Entry& b) {
+            return a.name == b.name;
+        });
+        m_entries.erase(m_entries.begin(), last.base());
+    }
+
+    const CMakeCacheView::Entry* CMakeCacheView::find(std::string_view name) const {
+        auto it = std::lower_bound(m_entries.begin(), m_entries.end(), name,
+            [](const Entry& entry, std::string_view name) { return entry.name < name; });
+        if (it == m_entries.end() || it->name != name)
+            return nullptr;
+        return &*it;
+    }
+
+    std::string_view CMakeCacheView::get(std::string_view name) const {
+        const Entry* entry = find(name);
+        return entry? entry->value : std::string_view();
+    }
+
+    std::string_view CMakeCacheView::type(std::string_view name) const {
+        const Entry* entry = find(name);
+        return entry? entry->type : std::string_view();
+    }
+}
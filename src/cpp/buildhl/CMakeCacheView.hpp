@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "MappedFile.hpp"
+
+namespace buildhl {
+    /** Read only view of a CMakeCache.txt.
+
+        The file is mapped and parsed once into a sorted array of entries
+        pointing into the mapping, lookups are a binary search. Entries like
+        FOO-ADVANCED are kept under their full name.
+
+        Not copyable or movable as entries point into the mapping, share
+        it through a pointer instead.
+    */
+    class CMakeCacheView {
+    public:
+        struct Entry {
+            std::string_view name;
+            /** BOOL, STRING, PATH, FILEPATH, INTERNAL, STATIC, ... */
+            std::string_view type;
+            std::string_view value;
+        };
+
+        CMakeCacheView(){}
+        explicit CMakeCacheView(const std::string& path) { load(path); }
+        CMakeCacheView(const CMakeCacheView&)=delete;
+        CMakeCacheView& operator=(const CMakeCacheView&)=delete;
+
+        /** @return false if the file doesn't exist, the view is empty then */
+        bool load(const std::string& path);
+        /** loads again if the file changed since, else does only a stat */
+        bool reload_if_changed();
+
+        /** @return the entry or nullptr */
+        const Entry* find(std::string_view name) const;
+        /** @return the value or empty if not set */
+        std::string_view get(std::string_view name) const;
+        std::string_view type(std::string_view name) const;
+
+        /** sorted by name */
+        const std::vector<Entry>& entries() const { return m_entries; }
+        const std::string& path() const { return m_path; }
+        /** mtime of the file when it was loaded, 0 if it didn't exist */
+        int64_t mtime() const { return m_mtime; }
+        bool empty() const { return m_entries.empty(); }
+    private:
+        void parse();
+
+        std::string         m_path;
+        MappedFile          m_file;
+        int64_t             m_mtime     = 0;
+        std::vector<Entry>  m_entries;
+    };
+}
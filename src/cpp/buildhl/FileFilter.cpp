@@ -97,12 +97,19 @@ namespace buildhl {
     std::string FileFilter::filter_for(const std::string& str, char delimiter) {
         if (str.find(delimiter) == std::string::npos)
             return find_file(str);
-        auto parts = tea::split(str, delimiter);
-        for (auto& part : parts) {
-            part = find_file(part);
+        // not tea::split, it drops an empty last part and so the delimiter
+        // a line ends with
+        std::string result;
+        std::size_t start = 0;
+        while (true) {
+            std::size_t end = str.find(delimiter, start);
+            result += find_file(str.substr(start, end - start));
+            if (end == std::string::npos)
+                break;
+            result += delimiter;
+            start = end + 1;
         }
-        std::string del(&delimiter, 1);
-        return tea::join(del, parts);
+        return result;
     }
     std::string FileFilter::filter(const std::string& str) {
         std::string result = str;
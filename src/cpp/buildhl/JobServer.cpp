@@ -0,0 +1,206 @@
+#include "JobServer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "system_info.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace buildhl {
+    /** how long a started job is assumed to take to reach its memory use */
+    constexpr std::chrono::seconds kGrowTime(2);
+
+    JobServer::JobServer(int jobs, int64_t job_memory) {
+        m_jobs          = jobs > 0? jobs : 1;
+        m_job_memory    = job_memory;
+        m_min_allowed   = m_jobs;
+        m_sampler       = sample_system;
+    }
+
+    JobServer::~JobServer() {
+        stop();
+    }
+
+    bool JobServer::supported() {
+#ifdef _WIN32
+        return false;
+#else
+        return true;
+#endif
+    }
+
+    JobServer::Sample JobServer::sample_system() {
+        Sample sample;
+        sample.available_memory = available_memory();
+        sample.load             = load_average();
+        sample.cpus             = cpu_count();
+        return sample;
+    }
+
+    int JobServer::idle_allowed(int jobs, int64_t job_memory, int recent_starts, const Sample& sample) {
+        // our own jobs are part of the load
+        int busy = std::max(sample.cpus, jobs);
+        if (sample.load >= 0 && sample.load > busy*1.5)
+            return 0;
+        if (sample.available_memory < 0)
+            return jobs;
+        // jobs that just started haven't had time to allocate yet
+        int64_t available = sample.available_memory - recent_starts*job_memory;
+        return std::max<int64_t>(available, 0)/job_memory;
+    }
+
+    int JobServer::idle_allowed() const {
+        return idle_allowed(m_jobs, m_job_memory, m_recent_starts.size(), m_sampler());
+    }
+
+    JobServer::InheritClient::InheritClient(JobServer* server) : m_server(server) {
+        if (m_server != nullptr)
+            m_server->set_client_inherited(true);
+    }
+
+    JobServer::InheritClient::~InheritClient() {
+        if (m_server != nullptr)
+            m_server->set_client_inherited(false);
+    }
+
+    std::string JobServer::makeflags(bool fifo) const {
+        std::string flags = "-j" + std::to_string(m_jobs) + " --jobserver-auth=";
+        if (fifo)
+            return flags + "fifo:" + m_path;
+        return flags + std::to_string(m_client_fd) + "," + std::to_string(m_client_fd);
+    }
+
+#ifdef _WIN32
+    bool JobServer::start(const std::string&) { return false; }
+    void JobServer::stop() {}
+    void JobServer::run() {}
+    void JobServer::adjust() {}
+    void JobServer::set_client_inherited(bool) {}
+#else
+    bool JobServer::start(const std::string& path) {
+        if (m_thread.joinable())
+            return true;
+        unlink(path.c_str());
+        if (mkfifo(path.c_str(), 0600) != 0)
+            return false;
+        // read & write so we never see EOF or block while nobody else has it open
+        m_fd = ::open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (m_fd < 0) {
+            unlink(path.c_str());
+            return false;
+        }
+        m_client_fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+        m_path = path;
+        if (m_client_fd < 0) {
+            stop();
+            return false;
+        }
+        // whoever runs first has an implicit token, the rest start held back
+        m_held = m_jobs - 1;
+        int tokens = std::min(m_held, idle_allowed());
+        std::vector<char> buffer(tokens, '+');
+        if (tokens > 0 && write(m_fd, buffer.data(), tokens) == tokens) {
+            m_held      -= tokens;
+            m_waiting   = tokens;
+        }
+        m_min_allowed = m_jobs - m_held;
+        m_running = true;
+        m_thread = std::thread([this]() { run(); });
+        return true;
+    }
+
+    void JobServer::stop() {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_running = false;
+        }
+        m_stop_condition.notify_all();
+        if (m_thread.joinable())
+            m_thread.join();
+        if (m_fd >= 0) {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+        if (m_client_fd >= 0) {
+            ::close(m_client_fd);
+            m_client_fd = -1;
+        }
+        if (!m_path.empty())
+            unlink(m_path.c_str());
+    }
+
+    void JobServer::run() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_running) {
+            lock.unlock();
+            adjust();
+            lock.lock();
+            m_stop_condition.wait_for(lock, std::chrono::milliseconds(250),
+                [this]() { return !m_running; });
+        }
+    }
+
+    /*  Builds running at once spawn from their own threads, the flag is
+        cleared while any of them spawns make. Something else started in
+        that moment inherits it too, which is harmless but rare.
+    */
+    void JobServer::set_client_inherited(bool inherited) {
+        std::unique_lock<std::mutex> lock(m_inherit_mutex);
+        m_inheriting += inherited? 1 : -1;
+        if (m_client_fd < 0 || m_inheriting != (inherited? 1 : 0))
+            return;
+        fcntl(m_client_fd, F_SETFD, inherited? 0 : FD_CLOEXEC);
+    }
+
+    /*  A token waiting in the fifo is a job that could start any moment and
+        use up to m_job_memory, so only as many wait as there is memory for.
+        Extra ones are taken back right away, new ones are put in one per
+        step to give started jobs time to grow.
+    */
+    void JobServer::adjust() {
+        int waiting = 0;
+        if (ioctl(m_fd, FIONREAD, &waiting) != 0)
+            return;
+        // every token that left the fifo since last time started a job
+        auto now = std::chrono::steady_clock::now();
+        for (int i = waiting; i < m_waiting; ++i)
+            m_recent_starts.push_back(now);
+        while (!m_recent_starts.empty() && now - m_recent_starts.front() > kGrowTime)
+            m_recent_starts.pop_front();
+
+        int allowed = idle_allowed();
+        if (waiting > allowed) {
+            char tokens[64];
+            int count = std::min<int>(waiting - allowed, sizeof(tokens));
+            ssize_t taken = read(m_fd, tokens, count);
+            if (taken > 0) {
+                m_held += taken;
+                waiting -= taken;
+            }
+        } else if (waiting < allowed && m_held > 0) {
+            char token = '+';
+            if (write(m_fd, &token, 1) == 1) {
+                --m_held;
+                ++waiting;
+            }
+        }
+        m_waiting = waiting;
+        if (m_jobs - m_held < m_min_allowed)
+            m_min_allowed = m_jobs - m_held;
+    }
+#endif
+
+    std::string JobServer::summary() const {
+        if (m_min_allowed >= m_jobs)
+            return "";
+        return "[jobserver] went down to " + std::to_string(m_min_allowed)
+            + " of " + std::to_string(m_jobs) + " jobs for memory or load";
+    }
+}
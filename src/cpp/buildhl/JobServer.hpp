@@ -0,0 +1,118 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace buildhl {
+    /** A GNU make jobserver.
+
+        It is a named fifo, ninja 1.13+ and make 4.4+ join it by path. For
+        older make an inherited file descriptor of it is passed instead,
+        the pipe protocol. Unlike make's own jobserver the number
+        of tokens in circulation follows the memory available: tokens only
+        wait in the fifo while there is memory for the jobs they would
+        start, the rest are held back until there is room again. No tokens
+        wait while the load is far above the number of CPUs.
+
+        Not available on windows.
+    */
+    class JobServer {
+    public:
+        /** @param jobs        most jobs to run in parallel
+            @param job_memory  memory to keep available per extra job
+        */
+        JobServer(int jobs, int64_t job_memory);
+        ~JobServer();
+        JobServer(const JobServer&)=delete;
+        JobServer& operator=(const JobServer&)=delete;
+
+        /** what throttling depends on, taken every step */
+        struct Sample {
+            /** bytes, -1 if unknown */
+            int64_t available_memory    = -1;
+            /** 1 minute load average, -1 if unknown */
+            double  load                = -1;
+            int     cpus                = 1;
+        };
+        typedef std::function<Sample()> Sampler;
+
+        static bool supported();
+        /** the memory and load of the system now */
+        static Sample sample_system();
+        /** Tokens that may wait in the fifo.
+            @param recent_starts    jobs started too recently to have
+                                    allocated their memory yet
+        */
+        static int idle_allowed(int jobs, int64_t job_memory, int recent_starts, const Sample& sample);
+
+        /** replaces sample_system(), for tests and benchmarks. Set it
+            before start().
+        */
+        void set_sampler(Sampler sampler) { m_sampler = sampler; }
+
+        /** creates the fifo at path and starts managing the tokens */
+        bool start(const std::string& path);
+        void stop();
+
+        /** to add to MAKEFLAGS of the build command
+            @param fifo     use the fifo protocol, else the pipe protocol
+        */
+        std::string makeflags(bool fifo) const;
+
+        /** The descriptor of the pipe protocol is close on exec so ninja
+            and everything else we start don't hold it. While one of these
+            is alive processes started inherit it, wrap the spawn of make
+            with it.
+        */
+        class InheritClient {
+        public:
+            /** @param server  may be null, does nothing then */
+            explicit InheritClient(JobServer* server);
+            ~InheritClient();
+            InheritClient(const InheritClient&)=delete;
+            InheritClient& operator=(const InheritClient&)=delete;
+        private:
+            JobServer* m_server;
+        };
+
+        int jobs() const { return m_jobs; }
+        /** fewest jobs allowed at once during the build */
+        int min_allowed() const { return m_min_allowed; }
+        /** @return line for the build summary, empty if it never throttled */
+        std::string summary() const;
+    private:
+        void run();
+        void adjust();
+        /** tokens that may wait in the fifo for the memory and load now */
+        int idle_allowed() const;
+        void set_client_inherited(bool inherited);
+
+        int             m_jobs;
+        int64_t         m_job_memory;
+        std::string     m_path;
+        int             m_fd        = -1;
+        /** inherited by the build for the pipe protocol */
+        int             m_client_fd = -1;
+        /** InheritClient alive */
+        int             m_inheriting = 0;
+        std::mutex      m_inherit_mutex;
+        Sampler         m_sampler;
+        /** tokens taken out of circulation */
+        int             m_held      = 0;
+        /** tokens in the fifo after the last adjust */
+        int             m_waiting   = 0;
+        std::deque<std::chrono::steady_clock::time_point> m_recent_starts;
+        int             m_min_allowed;
+
+        std::thread             m_thread;
+        std::mutex              m_mutex;
+        std::condition_variable m_stop_condition;
+        bool                    m_running   = false;
+    };
+}
@@ -0,0 +1,97 @@
+#include "LineReader.hpp"
+
+#include <algorithm>
+
+namespace buildhl {
+    namespace {
+        constexpr size_t kBlockSize = 16*1024;
+    }
+
+    bool LineReader::fill() {
+        if (m_end)
+            return false;
+        char block[kBlockSize];
+        ssize_t transfered = m_input.read(block, sizeof(block));
+        if (transfered <= 0) {
+            m_end = true;
+            return false;
+        }
+        m_buffer.append(block, transfered);
+        return true;
+    }
+
+    size_t LineReader::find_end() const {
+        size_t found = m_buffer.find_first_of("\r\n", m_scanned);
+        // a "\r" at the end may be the first half of "\r\n"
+        if (found != std::string::npos && m_buffer[found] == '\r'
+                && found + 1 == m_buffer.size() && !m_end)
+            return std::string::npos;
+        return found;
+    }
+
+    size_t LineReader::unended() const {
+        size_t end = m_buffer.size();
+        if (end > m_pos && m_buffer[end - 1] == '\r')
+            --end;
+        return end;
+    }
+
+    bool LineReader::buffered() const {
+        return m_end || find_end() != std::string::npos
+            || unended() > std::max(m_pos, m_reported);
+    }
+
+    LineReader::Kind LineReader::next(std::string& text, bool wait) {
+        // drop what was returned so the buffer doesn't grow
+        if (m_pos == m_buffer.size()) {
+            m_buffer.clear();
+            m_pos = m_scanned = m_reported = 0;
+        } else if (m_pos >= kBlockSize) {
+            m_buffer.erase(0, m_pos);
+            m_scanned -= m_pos;
+            m_reported -= std::min(m_reported, m_pos);
+            m_pos = 0;
+        }
+        bool read = false;
+        while (true) {
+            size_t found = find_end();
+            if (found == std::string::npos) {
+                m_scanned = unended();
+                // without wait what wasn't returned yet goes first
+                bool news = m_scanned > std::max(m_pos, m_reported);
+                if ((wait || !(read || news)) && fill()) {
+                    read = true;
+                    continue;
+                }
+                // a "\r" left at the end ends the last line
+                if (m_end && m_scanned < m_buffer.size())
+                    continue;
+                if (!m_end) {
+                    text.assign(m_buffer, m_pos, m_scanned - m_pos);
+                    m_reported = m_scanned;
+                    return Kind::partial;
+                }
+                if (m_pos == m_buffer.size())
+                    return Kind::end;
+                text.assign(m_buffer, m_pos, std::string::npos);
+                m_pos = m_scanned = m_buffer.size();
+                return Kind::line;
+            }
+            bool crlf = m_buffer[found] == '\r' && found + 1 < m_buffer.size()
+                && m_buffer[found + 1] == '\n';
+            // the last status stays on the terminal, it is the last line
+            bool last = m_buffer[found] == '\r' && found + 1 == m_buffer.size();
+            size_t start = m_pos;
+            m_pos = m_scanned = found + (crlf? 2 : 1);
+            // "\r" at the start of a line overwrites nothing
+            if (m_buffer[found] == '\r' && !crlf && found == start)
+                continue;
+            text.assign(m_buffer, start, found - start);
+            if (m_buffer[found] == '\n' || crlf || last) {
+                text += '\n';
+                return Kind::line;
+            }
+            return Kind::overwritten;
+        }
+    }
+}
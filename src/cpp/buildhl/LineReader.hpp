@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+
+#include "project_detect.hpp"
+
+namespace buildhl {
+    /** Splits a stream into lines, reading it in blocks.
+
+        Tools showing their progress on a terminal rewrite the status with
+        "\r". Every part of a line a "\r" ends is overwritten on the
+        terminal, only the last part is the line to show. "\r\n" ends a
+        line like "\n".
+    */
+    class LineReader {
+    public:
+        explicit LineReader(InputStream& input) : m_input(input) {}
+
+        enum class Kind {
+            /** a line with its "\n", or the rest at the end of the input */
+            line,
+            /** a status a "\r" overwrote, only good for the progress */
+            overwritten,
+            /** what was read of a segment that isn't ended yet, it is
+                returned again once it is. Only good for the progress.
+            */
+            partial,
+            /** end of input */
+            end
+        };
+        /** Reads until the next "\n" or "\r".
+
+            @param text     set to the line or status
+            @param wait     false to read at most once, for callers that
+                            poll the input first. Instead of reading again
+                            the unended segment is returned as partial.
+        */
+        Kind next(std::string& text, bool wait=true);
+        /** next() returns without reading */
+        bool buffered() const;
+        /** No more is read, next() returns what is buffered as lines. For
+            a pipe something else holds open after the tool exited.
+        */
+        void end_input() { m_end = true; }
+    private:
+        /** @return false at the end of input */
+        bool fill();
+        /** position of the "\r" or "\n" ending the next segment, npos if
+            it isn't in the buffer yet
+        */
+        size_t find_end() const;
+        /** end of the segment being read, without a "\r" that may be
+            followed by "\n"
+        */
+        size_t unended() const;
+
+        InputStream&    m_input;
+        std::string     m_buffer;
+        /** start of what next() didn't return yet */
+        size_t          m_pos       = 0;
+        /** m_buffer from m_pos up to here has no "\r" or "\n" */
+        size_t          m_scanned   = 0;
+        /** m_buffer up to here was returned as partial */
+        size_t          m_reported  = 0;
+        bool            m_end       = false;
+    };
+}
@@ -0,0 +1,77 @@
+#include "MappedFile.hpp"
+
+#include <teaport_utils/fileutils.hpp>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace buildhl {
+    MappedFile& MappedFile::operator=(MappedFile&& other) {
+        close();
+        m_open      = other.m_open;
+        m_size      = other.m_size;
+        m_fallback  = std::move(other.m_fallback);
+        m_data      = m_fallback.empty()? other.m_data : m_fallback.data();
+        other.m_data = nullptr;
+        other.m_size = 0;
+        other.m_open = false;
+        return *this;
+    }
+#ifdef _WIN32
+    bool MappedFile::open(const std::string& path) {
+        close();
+        if (!tea::is_file(path))
+            return false;
+        m_fallback  = tea::file_get_contents(path);
+        m_data      = m_fallback.data();
+        m_size      = m_fallback.size();
+        m_open      = true;
+        return true;
+    }
+    void MappedFile::close() {
+        m_fallback.clear();
+        m_data = nullptr;
+        m_size = 0;
+        m_open = false;
+    }
+#else
+    bool MappedFile::open(const std::string& path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            ::close(fd);
+            return false;
+        }
+        m_size = st.st_size;
+        m_open = true;
+        if (m_size == 0) {
+            ::close(fd);
+            return true;
+        }
+        void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            m_size = 0;
+            m_open = false;
+            return false;
+        }
+        m_data = static_cast<const char*>(data);
+        return true;
+    }
+    void MappedFile::close() {
+        if (m_data != nullptr && m_fallback.empty())
+            munmap(const_cast<char*>(m_data), m_size);
+        m_fallback.clear();
+        m_data = nullptr;
+        m_size = 0;
+        m_open = false;
+    }
+#endif
+}
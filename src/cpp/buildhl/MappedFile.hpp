@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace buildhl {
+    /** Read only view of a whole file. Uses mmap where available so large
+        files aren't copied into memory.
+    */
+    class MappedFile {
+    public:
+        MappedFile(){}
+        explicit MappedFile(const std::string& path) { open(path); }
+        ~MappedFile() { close(); }
+        MappedFile(const MappedFile&)=delete;
+        MappedFile& operator=(const MappedFile&)=delete;
+        MappedFile(MappedFile&& other) { *this = std::move(other); }
+        MappedFile& operator=(MappedFile&& other);
+
+        /** @return true if the file could be opened. Empty files are valid. */
+        bool open(const std::string& path);
+        void close();
+
+        const char* data() const { return m_data; }
+        size_t size() const { return m_size; }
+        std::string_view view() const { return {m_data, m_size}; }
+        explicit operator bool() const { return m_open; }
+    private:
+        const char* m_data  = nullptr;
+        size_t      m_size  = 0;
+        bool        m_open  = false;
+        /** used when mmap isn't available */
+        std::string m_fallback;
+    };
+}
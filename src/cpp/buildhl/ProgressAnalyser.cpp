@@ -1,8 +1,8 @@
 #include "ProgressAnalyser.hpp"
 
 #include <subprocess.hpp>
-#include <regex>
 #include <algorithm>
+#include <cstring>
 
 #ifdef min
 #undef min
@@ -40,13 +40,78 @@ namespace buildhl {
         return get_complete();
     }
 
+    Progress parse_ninja_status(const std::string& line, size_t* status_length) {
+        *status_length = 0;
+        const size_t sentinel_size = strlen(kNinjaStatusSentinel);
+        if (line.compare(0, sentinel_size, kNinjaStatusSentinel) != 0)
+            return {};
+        const char* cursor  = line.c_str() + sentinel_size;
+        auto read_uint = [&cursor](char delimiter, double& value) {
+            value = 0;
+            const char* start = cursor;
+            while (*cursor >= '0' && *cursor <= '9') {
+                value = value*10 + (*cursor - '0');
+                ++cursor;
+            }
+            if (cursor == start || *cursor != delimiter)
+                return false;
+            ++cursor;
+            return true;
+        };
+        Progress progress;
+        double running = 0;
+        double elapsed_whole = 0;
+        if (!read_uint('/', progress.complete) || !read_uint('/', progress.total)
+            || !read_uint('/', running) || !read_uint('.', elapsed_whole))
+            return {};
+        double elapsed_fraction = 0;
+        double scale = 1;
+        while (*cursor >= '0' && *cursor <= '9') {
+            elapsed_fraction = elapsed_fraction*10 + (*cursor - '0');
+            scale *= 10;
+            ++cursor;
+        }
+        if (cursor[0] != '@' || cursor[1] != ' ')
+            return {};
+        cursor += 2;
+        progress.running = running;
+        progress.elapsed = elapsed_whole + elapsed_fraction/scale;
+        *status_length = cursor - line.c_str();
+        return progress;
+    }
+
+    namespace {
+        bool is_digit(char ch) { return ch >= '0' && ch <= '9'; }
+        bool is_space(char ch) { return ch == ' ' || (ch >= '\t' && ch <= '\r'); }
+        /** reads the digits at pos, they must be there */
+        double read_number(const std::string& line, size_t& pos) {
+            double value = 0;
+            for (; pos < line.size() && is_digit(line[pos]); ++pos)
+                value = value*10 + (line[pos] - '0');
+            return value;
+        }
+    }
+
     Progress parse_progress(const std::string& line) {
-        std::regex reg("(\\d+)\\s*/\\s*(\\d+)");
-        std::smatch match;
-        if(std::regex_search(line, match, reg)) {
+        // the first "<digits> / <digits>", by hand as it runs for every line
+        for (size_t pos = 0; pos < line.size();) {
+            if (!is_digit(line[pos])) {
+                ++pos;
+                continue;
+            }
             Progress progress;
-            progress.complete   = std::stod(match[1]);
-            progress.total      = std::stod(match[2]);
+            progress.complete = read_number(line, pos);
+            size_t cursor = pos;
+            while (cursor < line.size() && is_space(line[cursor]))
+                ++cursor;
+            if (cursor == line.size() || line[cursor] != '/')
+                continue;
+            ++cursor;
+            while (cursor < line.size() && is_space(line[cursor]))
+                ++cursor;
+            if (cursor == line.size() || !is_digit(line[cursor]))
+                continue;
+            progress.total = read_number(line, cursor);
             // if this is the case probably it's not a progress indicator
             if (progress.complete > progress.total)
                 return {};
@@ -85,6 +85,10 @@ namespace buildhl {
     struct Progress {
         double complete = 0;
         double total    = 0;
+        /** jobs currently running, -1 if unknown */
+        int    running  = -1;
+        /** seconds since the build tool started, -1 if unknown */
+        double elapsed  = -1;
 
         operator double() const {
             if (!*this)
@@ -97,6 +101,22 @@ namespace buildhl {
         }
     };
 
+    /** Prefix of kNinjaStatusFormat. Lines starting with it are status lines
+        produced by ninja using our NINJA_STATUS.
+    */
+    constexpr const char* kNinjaStatusSentinel = "@bhl@";
+    /** NINJA_STATUS buildhl sets for ninja builds. Layout is
+        "@bhl@<finished>/<total>/<running>/<elapsed>@ "
+    */
+    constexpr const char* kNinjaStatusFormat = "@bhl@%f/%t/%r/%e@ ";
+
+    /** Decodes a status prefix produced by kNinjaStatusFormat.
+
+        @param status_length    set to the length of the status prefix, 0 if
+                                the line doesn't start with one.
+        @return progress found, empty if the line has no status prefix.
+    */
+    Progress parse_ninja_status(const std::string& line, size_t* status_length);
     Progress parse_progress(const std::string& line);
     std::string render_progress(double progress, int width);
     std::string left_pad(std::string var, int length, const std::string& what=" ");
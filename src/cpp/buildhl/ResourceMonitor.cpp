@@ -0,0 +1,320 @@
+#include "ResourceMonitor.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace buildhl {
+    ResourceMonitor::ResourceMonitor(subprocess::pid_t root, double interval) {
+        m_root      = root;
+        m_interval  = interval;
+    }
+
+    ResourceMonitor::~ResourceMonitor() {
+        stop();
+#ifdef __linux__
+        if (m_proc_dir != nullptr)
+            closedir(static_cast<DIR*>(m_proc_dir));
+#endif
+    }
+
+    bool ResourceMonitor::supported() {
+#ifdef __linux__
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void ResourceMonitor::start() {
+        if (!supported() || m_interval <= 0 || m_thread.joinable())
+            return;
+#ifdef __linux__
+        m_proc_dir = opendir("/proc");
+        if (m_proc_dir == nullptr)
+            return;
+        m_page_size     = sysconf(_SC_PAGESIZE);
+        m_ticks_per_sec = sysconf(_SC_CLK_TCK);
+#endif
+        m_buffer.resize(64*1024);
+        m_processes.reserve(4096);
+        m_new.reserve(1024);
+        m_dead.reserve(1024);
+        m_active.reserve(1024);
+        m_running = true;
+        m_start_time = std::chrono::steady_clock::now();
+        m_thread = std::thread([this]() { run(); });
+    }
+
+    void ResourceMonitor::stop() {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_running = false;
+        }
+        m_stop_condition.notify_all();
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+    void ResourceMonitor::run() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_running) {
+            lock.unlock();
+            sample();
+            lock.lock();
+            m_stop_condition.wait_for(lock, std::chrono::duration<double>(m_interval),
+                [this]() { return !m_running; });
+        }
+    }
+
+#ifdef __linux__
+    bool ResourceMonitor::read_stat(int pid, int& ppid, uint64_t& start_time, uint64_t& cpu_ticks, int64_t& rss) {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+        int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+        ssize_t size = ::read(fd, m_buffer.data(), m_buffer.size()-1);
+        ::close(fd);
+        if (size <= 0)
+            return false;
+        m_buffer[size] = 0;
+        // comm can have spaces and parenthesis, fields start after the last ')'
+        char* cursor = strrchr(m_buffer.data(), ')');
+        if (cursor == nullptr)
+            return false;
+        cursor += 2;
+        // cursor is at field 3, state
+        uint64_t fields[25] = {0};
+        for (int field = 3; field <= 24 && *cursor; ++field) {
+            if (field == 3) {
+                ++cursor;
+            } else {
+                fields[field] = strtoull(cursor, &cursor, 10);
+            }
+            while (*cursor == ' ')
+                ++cursor;
+        }
+        ppid        = fields[4];
+        cpu_ticks   = fields[14] + fields[15];
+        start_time  = fields[22];
+        rss         = fields[24] * m_page_size;
+        return true;
+    }
+
+    void ResourceMonitor::read_name(int pid, Invocation& invocation) {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/cmdline", pid);
+        int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        ssize_t size = 0;
+        if (fd >= 0) {
+            size = ::read(fd, m_buffer.data(), m_buffer.size()-1);
+            ::close(fd);
+        }
+        // exited already, keep what we have
+        if (size <= 0) {
+            if (invocation.usage.name.empty())
+                invocation.usage.name = "?";
+            return;
+        }
+        m_buffer[size] = 0;
+
+        const char* end = m_buffer.data() + size;
+        const char* exe = m_buffer.data();
+        for (const char* arg = exe; arg < end; arg += strlen(arg) + 1) {
+            if (arg[0] == '-' && arg[1] == 'o') {
+                const char* output = arg[2]? arg + 2 : arg + strlen(arg) + 1;
+                if (output < end && *output) {
+                    invocation.usage.name = output;
+                    invocation.usage.has_output = true;
+                    return;
+                }
+                break;
+            }
+        }
+        const char* slash = strrchr(exe, '/');
+        const char* name = slash? slash + 1 : exe;
+        if (invocation.usage.name != name)
+            invocation.usage.name = name;
+    }
+
+    int ResourceMonitor::invocation_for(int pid, int ppid) {
+        auto parent = m_processes.find(ppid);
+        if (parent != m_processes.end() && parent->second.invocation >= 0
+            && m_invocations[parent->second.invocation].usage.has_output) {
+            return parent->second.invocation;
+        }
+        m_invocations.emplace_back();
+        read_name(pid, m_invocations.back());
+        return m_invocations.size() - 1;
+    }
+
+    void ResourceMonitor::add_sample(int index, uint64_t cpu_ticks, int64_t rss) {
+        Invocation& invocation = m_invocations[index];
+        if (invocation.sample_generation != m_generation) {
+            invocation.sample_generation    = m_generation;
+            invocation.sample_rss           = 0;
+            invocation.live_ticks           = 0;
+            if (invocation.first_seen < 0)
+                invocation.first_seen = m_sample_time;
+            invocation.last_seen            = m_sample_time;
+            m_active.push_back(index);
+        }
+        invocation.sample_rss += rss;
+        invocation.live_ticks += cpu_ticks;
+    }
+
+    void ResourceMonitor::forget(Process& process) {
+        if (process.descendant && process.invocation >= 0)
+            m_invocations[process.invocation].finished_ticks += process.cpu_ticks;
+    }
+
+    void ResourceMonitor::sample() {
+        DIR* dir = static_cast<DIR*>(m_proc_dir);
+        ++m_generation;
+        m_sample_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start_time).count();
+        rewinddir(dir);
+        m_new.clear();
+        m_active.clear();
+        int64_t total_rss = 0;
+        while (dirent* entry = readdir(dir)) {
+            const char* name = entry->d_name;
+            if (*name < '0' || *name > '9')
+                continue;
+            int pid = atoi(name);
+            auto it = m_processes.find(pid);
+            if (it != m_processes.end() && !it->second.descendant) {
+                // not ours, it can't become ours later
+                it->second.generation = m_generation;
+                continue;
+            }
+            NewProcess info;
+            info.pid = pid;
+            if (!read_stat(pid, info.ppid, info.start_time, info.cpu_ticks, info.rss))
+                continue;
+            if (it != m_processes.end() && it->second.start_time == info.start_time) {
+                Process& process    = it->second;
+                process.generation  = m_generation;
+                process.cpu_ticks   = info.cpu_ticks;
+                // sh -c may exec the compiler after we first saw it
+                if (process.owner && !m_invocations[process.invocation].usage.has_output)
+                    read_name(pid, m_invocations[process.invocation]);
+                add_sample(process.invocation, info.cpu_ticks, info.rss);
+                total_rss += info.rss;
+                continue;
+            }
+            if (it != m_processes.end()) {
+                // pid got reused
+                forget(it->second);
+                m_processes.erase(it);
+            }
+            m_new.push_back(info);
+        }
+
+        // parents usually have lower pids, retry the rest for pid wrap around
+        std::sort(m_new.begin(), m_new.end(), [](const NewProcess& a, const NewProcess& b) {
+            return a.pid < b.pid;
+        });
+        // m_dead is free to use as a sorted list of the new pids
+        m_dead.clear();
+        for (auto& info : m_new)
+            m_dead.push_back(info.pid);
+        for (int pass = 0; pass < 3 && !m_new.empty(); ++pass) {
+            size_t deferred = 0;
+            for (auto& info : m_new) {
+                bool descendant = info.pid == (int)m_root || info.ppid == (int)m_root;
+                bool known = descendant;
+                if (!known) {
+                    auto parent = m_processes.find(info.ppid);
+                    if (parent != m_processes.end()) {
+                        known = true;
+                        descendant = parent->second.descendant;
+                    }
+                }
+                if (!known && pass < 2) {
+                    if (std::binary_search(m_dead.begin(), m_dead.end(), info.ppid)) {
+                        m_new[deferred++] = info;
+                        continue;
+                    }
+                }
+                Process process;
+                process.generation  = m_generation;
+                process.start_time  = info.start_time;
+                process.descendant  = descendant;
+                if (descendant) {
+                    size_t invocations  = m_invocations.size();
+                    process.cpu_ticks   = info.cpu_ticks;
+                    process.invocation  = invocation_for(info.pid, info.ppid);
+                    process.owner       = m_invocations.size() != invocations;
+                    add_sample(process.invocation, info.cpu_ticks, info.rss);
+                    total_rss += info.rss;
+                }
+                m_processes[info.pid] = process;
+            }
+            m_new.resize(deferred);
+        }
+
+        m_dead.clear();
+        for (auto& pair : m_processes) {
+            if (pair.second.generation != m_generation)
+                m_dead.push_back(pair.first);
+        }
+        for (int pid : m_dead) {
+            auto it = m_processes.find(pid);
+            forget(it->second);
+            m_processes.erase(it);
+        }
+
+        for (int index : m_active) {
+            auto& usage = m_invocations[index].usage;
+            usage.peak_rss = std::max(usage.peak_rss, m_invocations[index].sample_rss);
+        }
+        m_current_rss = total_rss;
+        if (total_rss > m_peak_rss)
+            m_peak_rss = total_rss;
+    }
+#else
+    bool ResourceMonitor::read_stat(int, int&, uint64_t&, uint64_t&, int64_t&) { return false; }
+    void ResourceMonitor::read_name(int, Invocation&) {}
+    int ResourceMonitor::invocation_for(int, int) { return -1; }
+    void ResourceMonitor::add_sample(int, uint64_t, int64_t) {}
+    void ResourceMonitor::forget(Process&) {}
+    void ResourceMonitor::sample() {}
+#endif
+
+    uint64_t ResourceMonitor::invocation_ticks(const Invocation& invocation) const {
+        uint64_t ticks = invocation.finished_ticks;
+        if (invocation.sample_generation == m_generation)
+            ticks += invocation.live_ticks;
+        return ticks;
+    }
+
+    std::vector<InvocationUsage> ResourceMonitor::invocations() const {
+        std::vector<InvocationUsage> result;
+        result.reserve(m_invocations.size());
+        for (auto& invocation : m_invocations) {
+            InvocationUsage usage = invocation.usage;
+            usage.cpu_seconds = invocation_ticks(invocation) / m_ticks_per_sec;
+            if (invocation.first_seen >= 0)
+                usage.wall_seconds = invocation.last_seen - invocation.first_seen;
+            result.push_back(std::move(usage));
+        }
+        return result;
+    }
+
+    std::vector<InvocationUsage> ResourceMonitor::top_memory(int count) const {
+        auto result = invocations();
+        std::sort(result.begin(), result.end(), [](const InvocationUsage& a, const InvocationUsage& b) {
+            return a.peak_rss > b.peak_rss;
+        });
+        if ((int)result.size() > count)
+            result.resize(count);
+        return result;
+    }
+}
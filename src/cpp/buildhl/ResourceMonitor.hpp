@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <subprocess.hpp>
+
+namespace buildhl {
+    /** Resources used by one tool invocation, e.g. compiling one object. */
+    struct InvocationUsage {
+        /** output file if the command line had -o, else the executable */
+        std::string name;
+        double      cpu_seconds = 0;
+        /** peak of the summed RSS of the invocation and its children */
+        int64_t     peak_rss    = 0;
+        /** time between the first and the last sample that saw it, so
+            only as precise as the sampling interval */
+        double      wall_seconds = 0;
+        /** name is an output file, so most likely a compiler or linker */
+        bool        has_output  = false;
+    };
+
+    /** Samples /proc for all descendants of a process.
+
+        Compiler drivers are matched to their output file through -o on
+        their command line and helpers they spawn (cc1plus, as, ...) are
+        attributed to them. Sampling only reads stat of processes it hasn't
+        seen before or knows are descendants and reuses its buffers. What
+        a sample still allocates is a map entry for each new process and an
+        InvocationUsage with its name for each new invocation.
+
+        Only supported on linux, elsewhere it does nothing.
+    */
+    class ResourceMonitor {
+    public:
+        /** @param interval seconds between samples */
+        ResourceMonitor(subprocess::pid_t root, double interval);
+        ~ResourceMonitor();
+        ResourceMonitor(const ResourceMonitor&)=delete;
+        ResourceMonitor& operator=(const ResourceMonitor&)=delete;
+
+        static bool supported();
+
+        void start();
+        /** stops sampling, results are only safe to read after this */
+        void stop();
+
+        /** RSS of all descendants at the last sample, safe to call anytime */
+        int64_t current_rss() const { return m_current_rss; }
+        /** peak of the summed RSS of all descendants */
+        int64_t peak_rss() const { return m_peak_rss; }
+
+        /** @return the invocations using the most memory, highest first */
+        std::vector<InvocationUsage> top_memory(int count) const;
+        /** @return every invocation seen */
+        std::vector<InvocationUsage> invocations() const;
+    private:
+        struct Process {
+            uint64_t    generation  = 0;
+            uint64_t    start_time  = 0;
+            bool        descendant  = false;
+            int         invocation  = -1;
+            /** invocation was created for this process, not inherited */
+            bool        owner       = false;
+            /** utime + stime in clock ticks */
+            uint64_t    cpu_ticks   = 0;
+        };
+        struct Invocation {
+            /** helpers spawned by invocations with an output belong to them */
+            InvocationUsage usage;
+            uint64_t        finished_ticks      = 0;
+            uint64_t        live_ticks          = 0;
+            int64_t         sample_rss          = 0;
+            /** generation live_ticks and sample_rss are from */
+            uint64_t        sample_generation   = 0;
+            /** seconds since the monitor started it was first seen, -1 if never */
+            double          first_seen          = -1;
+            double          last_seen           = 0;
+        };
+        struct NewProcess {
+            int         pid;
+            int         ppid;
+            uint64_t    start_time;
+            uint64_t    cpu_ticks;
+            int64_t     rss;
+        };
+
+        void run();
+        void sample();
+        bool read_stat(int pid, int& ppid, uint64_t& start_time, uint64_t& cpu_ticks, int64_t& rss);
+        int invocation_for(int pid, int ppid);
+        /** names the invocation after the -o of the command line of pid */
+        void read_name(int pid, Invocation& invocation);
+        void add_sample(int invocation, uint64_t cpu_ticks, int64_t rss);
+        void forget(Process& process);
+        uint64_t invocation_ticks(const Invocation& invocation) const;
+
+        subprocess::pid_t   m_root;
+        double              m_interval;
+        std::thread         m_thread;
+        std::mutex          m_mutex;
+        std::condition_variable m_stop_condition;
+        bool                m_running   = false;
+
+        std::atomic<int64_t> m_current_rss{0};
+        std::atomic<int64_t> m_peak_rss{0};
+
+        uint64_t                            m_generation = 0;
+        std::unordered_map<int, Process>    m_processes;
+        std::vector<Invocation>             m_invocations;
+        std::vector<NewProcess>             m_new;
+        std::vector<int>                    m_dead;
+        std::vector<int>                    m_active;
+        std::vector<char>                   m_buffer;
+        void*                               m_proc_dir      = nullptr;
+        std::chrono::steady_clock::time_point m_start_time;
+        /** seconds since m_start_time of the current sample */
+        double                              m_sample_time   = 0;
+        int64_t                             m_page_size     = 4096;
+        double                              m_ticks_per_sec = 100;
+    };
+}
@@ -0,0 +1,179 @@
+#include "ansi_escapes.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace buildhl {
+    namespace {
+        constexpr char kEsc = '\x1b';
+
+        bool in_range(char ch, uint8_t low, uint8_t high) {
+            return (uint8_t)ch >= low && (uint8_t)ch <= high;
+        }
+
+        /** @param complete set to false if the text ends inside it
+            @return length of the escape sequence starting at pos
+        */
+        size_t escape_length(std::string_view text, size_t pos, bool* complete=nullptr) {
+            bool ended = false;
+            size_t i = pos + 1;
+            if (i < text.size()) {
+                char kind = text[i++];
+                if (kind == '[') {
+                    // CSI: parameters and intermediates, then a final byte
+                    while (i < text.size() && in_range(text[i], 0x20, 0x3F))
+                        ++i;
+                    ended = i < text.size();
+                    if (ended && in_range(text[i], 0x40, 0x7E))
+                        ++i;
+                } else if (kind == ']' || kind == 'P' || kind == '^' || kind == '_') {
+                    // OSC and the other strings, ended by BEL or ST
+                    for (; i < text.size() && !ended; ++i) {
+                        if (text[i] == '\a') {
+                            ended = true;
+                        } else if (text[i] == kEsc && i + 1 < text.size() && text[i + 1] == '\\') {
+                            ended = true;
+                            ++i;
+                        }
+                    }
+                } else {
+                    // intermediates then a final byte, e.g. ESC ( B
+                    while (in_range(kind, 0x20, 0x2F) && i < text.size())
+                        kind = text[i++];
+                    ended = !in_range(kind, 0x20, 0x2F);
+                }
+            }
+            if (complete != nullptr)
+                *complete = ended;
+            return i - pos;
+        }
+
+        Escape::Kind escape_kind(std::string_view sequence) {
+            if (sequence.size() >= 3 && sequence[1] == '[' && sequence.back() == 'm')
+                return Escape::Kind::color;
+            if (sequence.compare(0, 4, "\x1b]8;") == 0)
+                return Escape::Kind::link;
+            return Escape::Kind::other;
+        }
+
+        /** decodes the UTF-8 code point at pos and moves past it, invalid
+            bytes are taken one at a time.
+        */
+        uint32_t next_code_point(std::string_view text, size_t& pos) {
+            uint8_t lead = text[pos++];
+            int extra = lead >= 0xF0? 3 : lead >= 0xE0? 2 : lead >= 0xC0? 1 : 0;
+            uint32_t code = extra == 3? lead & 0x07 : extra == 2? lead & 0x0F : extra == 1? lead & 0x1F : lead;
+            for (int i = 0; i < extra; ++i) {
+                if (pos >= text.size() || !in_range(text[pos], 0x80, 0xBF))
+                    return 0xFFFD;
+                code = (code << 6) | (text[pos++] & 0x3F);
+            }
+            return code;
+        }
+
+        int code_point_width(uint32_t code) {
+            if (code < 0x20 || (code >= 0x7F && code < 0xA0))
+                return 0;
+            if ((code >= 0x0300 && code <= 0x036F) || (code >= 0x200B && code <= 0x200F)
+                    || (code >= 0xFE00 && code <= 0xFE0F))
+                return 0;
+            bool wide = (code >= 0x1100 && code <= 0x115F)
+                || (code >= 0x2E80 && code <= 0xA4CF)
+                || (code >= 0xAC00 && code <= 0xD7A3)
+                || (code >= 0xF900 && code <= 0xFAFF)
+                || (code >= 0xFE30 && code <= 0xFE4F)
+                || (code >= 0xFF00 && code <= 0xFF60)
+                || (code >= 0xFFE0 && code <= 0xFFE6)
+                || (code >= 0x1F300 && code <= 0x1F64F)
+                || (code >= 0x1F900 && code <= 0x1F9FF)
+                || (code >= 0x20000 && code <= 0x3FFFD);
+            return wide? 2 : 1;
+        }
+    }
+
+    EscapedText split_escapes(std::string_view line) {
+        EscapedText result;
+        result.visible.reserve(line.size());
+        size_t pos = 0;
+        while (pos < line.size()) {
+            size_t esc = std::min(line.find(kEsc, pos), line.size());
+            result.visible.append(line.substr(pos, esc - pos));
+            if (esc == line.size())
+                break;
+            bool complete = false;
+            size_t length = escape_length(line, esc, &complete);
+            std::string_view sequence = line.substr(esc, length);
+            pos = esc + length;
+            if (!complete)
+                break;
+            result.escapes.push_back({result.visible.size(), std::string(sequence), escape_kind(sequence)});
+        }
+        return result;
+    }
+
+    void shift_escapes(std::vector<Escape>& escapes, size_t replaced, size_t prefix_size) {
+        for (auto& escape : escapes)
+            escape.offset = std::max(escape.offset, replaced) - replaced + prefix_size;
+    }
+
+    bool has_colors(const std::vector<Escape>& escapes) {
+        return std::any_of(escapes.begin(), escapes.end(), [](const Escape& escape) {
+            return escape.kind == Escape::Kind::color;
+        });
+    }
+
+    std::string join_escapes(const std::string& visible, const std::vector<Escape>& escapes,
+            const std::function<std::string(const std::string&)>& filter) {
+        std::string result;
+        result.reserve(visible.size() + visible.size()/2);
+        size_t pos = 0;
+        for (auto& escape : escapes) {
+            size_t offset = std::min(escape.offset, visible.size());
+            if (offset > pos) {
+                result += filter(visible.substr(pos, offset - pos));
+                pos = offset;
+            }
+            if (escape.kind != Escape::Kind::other)
+                result += escape.sequence;
+        }
+        if (pos < visible.size())
+            result += filter(visible.substr(pos));
+        return result;
+    }
+
+    size_t display_width(std::string_view text) {
+        size_t width = 0;
+        size_t pos = 0;
+        while (pos < text.size()) {
+            if (text[pos] == kEsc) {
+                pos += escape_length(text, pos);
+                continue;
+            }
+            width += code_point_width(next_code_point(text, pos));
+        }
+        return width;
+    }
+
+    std::string fit_width(std::string_view text, size_t columns) {
+        size_t width = 0;
+        size_t pos = 0;
+        bool full = false;
+        std::string result;
+        while (pos < text.size()) {
+            size_t start = pos;
+            if (text[pos] == kEsc) {
+                // past the end too, so a reset isn't lost
+                pos += escape_length(text, pos);
+                result.append(text.substr(start, pos - start));
+                continue;
+            }
+            int code_width = code_point_width(next_code_point(text, pos));
+            full = full || width + code_width > columns;
+            if (full)
+                continue;
+            width += code_width;
+            result.append(text.substr(start, pos - start));
+        }
+        return result;
+    }
+}
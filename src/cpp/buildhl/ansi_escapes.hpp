@@ -0,0 +1,55 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace buildhl {
+    /** An escape sequence taken out of a line. */
+    struct Escape {
+        enum class Kind {
+            /** SGR, sets colors and bold */
+            color,
+            /** OSC 8 hyperlink */
+            link,
+            /** cursor movement, erasing, titles... */
+            other
+        };
+        /** offset in the visible text it came before */
+        size_t      offset  = 0;
+        std::string sequence;
+        Kind        kind    = Kind::other;
+    };
+
+    /** A line split into the text a terminal shows and its escapes. */
+    struct EscapedText {
+        std::string         visible;
+        std::vector<Escape> escapes;
+    };
+
+    /** Splits line in one pass with a CSI/OSC state machine. A sequence
+        cut off by the end of the line is dropped.
+    */
+    EscapedText split_escapes(std::string_view line);
+    /** Moves the escapes along when the first replaced bytes of the visible
+        text were replaced by prefix_size bytes. Escapes in the replaced part
+        go after the new prefix.
+    */
+    void shift_escapes(std::vector<Escape>& escapes, size_t replaced, size_t prefix_size);
+    bool has_colors(const std::vector<Escape>& escapes);
+    /** Puts the colors and links back between the runs of visible text,
+        each run passed through filter. Other escapes are dropped, they
+        would move the cursor under our progress line.
+    */
+    std::string join_escapes(const std::string& visible, const std::vector<Escape>& escapes,
+        const std::function<std::string(const std::string&)>& filter);
+
+    /** Columns text takes on a terminal. Escapes take none, UTF-8 one per
+        code point except combining marks take none and wide east asian
+        characters and emoji two.
+    */
+    size_t display_width(std::string_view text);
+    /** text cut to at most columns, escapes are kept */
+    std::string fit_width(std::string_view text, size_t columns);
+}
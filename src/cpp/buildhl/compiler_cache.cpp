@@ -0,0 +1,207 @@
+#include "compiler_cache.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+
+#include <subprocess.hpp>
+#include <nlohmann/json.hpp>
+#include <teaport_utils/fileutils.hpp>
+#include <teaport_utils/stringutils.hpp>
+
+#include "BuildStore.hpp"
+#include "highlight.hpp"
+
+namespace buildhl {
+    namespace {
+        const char* kCompileSecondsKey = "compile_seconds";
+
+        /** environment that makes sccache use a remote backend */
+        const char* kSccacheRemoteEnv[] = {
+            "SCCACHE_BUCKET", "SCCACHE_REDIS", "SCCACHE_REDIS_ENDPOINT",
+            "SCCACHE_MEMCACHED", "SCCACHE_MEMCACHED_ENDPOINT", "SCCACHE_GCS_BUCKET",
+            "SCCACHE_AZURE_CONNECTION_STRING", "SCCACHE_GHA_ENABLED",
+            "SCCACHE_WEBDAV_ENDPOINT", "SCCACHE_OSS_BUCKET", "SCCACHE_DIST_SCHEDULER_URL"
+        };
+
+        bool ends_with(const std::string& str, const std::string& with) {
+            return str.size() >= with.size()
+                && str.compare(str.size() - with.size(), with.size(), with) == 0;
+        }
+
+        std::string program_name(const std::string& program) {
+            std::string name = tea::basename(program);
+            if (ends_with(name, ".exe"))
+                name.resize(name.size() - 4);
+            return name;
+        }
+
+        /** @return cout of command, empty if it failed */
+        std::string output_of(const std::vector<std::string>& command) {
+            try {
+                auto process = subprocess::RunBuilder(command)
+                    .cout(subprocess::PipeOption::pipe)
+                    .cerr(subprocess::PipeOption::pipe)
+                    .run();
+                if (!process)
+                    return "";
+                return process.cout;
+            } catch (std::exception&) {
+                return "";
+            }
+        }
+
+        bool ccache_is_local(const std::string& program) {
+            for (const char* name : {"CCACHE_REMOTE_STORAGE", "CCACHE_SECONDARY_STORAGE"}) {
+                if (!subprocess::cenv[name].to_string().empty())
+                    return false;
+            }
+            for (const char* key : {"remote_storage", "secondary_storage"}) {
+                std::string value = output_of({program, "--get-config", key});
+                if (value.find_first_not_of(" \r\n") != std::string::npos)
+                    return false;
+            }
+            return true;
+        }
+
+        bool sccache_is_local() {
+            for (const char* name : kSccacheRemoteEnv) {
+                if (!subprocess::cenv[name].to_string().empty())
+                    return false;
+            }
+            return true;
+        }
+
+        /** ccache 4 prints "name\tvalue", ccache 3 only has -s */
+        bool read_ccache_stats(const std::string& program, CompilerCacheStats& stats) {
+            std::string output = output_of({program, "--print-stats"});
+            bool found = false;
+            stats = {};
+            for (auto& line : tea::split_no_empty(output, '\n')) {
+                auto tab = line.find('\t');
+                if (tab == std::string::npos)
+                    continue;
+                std::string name = line.substr(0, tab);
+                int64_t value = std::strtoll(line.c_str() + tab + 1, nullptr, 10);
+                if (name == "direct_cache_hit" || name == "preprocessed_cache_hit") {
+                    stats.hits += value;
+                    found = true;
+                } else if (name == "cache_miss") {
+                    stats.misses += value;
+                    found = true;
+                }
+            }
+            if (found)
+                return true;
+
+            output = output_of({program, "-s"});
+            for (auto& line : tea::split_no_empty(output, '\n')) {
+                auto digits = line.find_last_not_of("0123456789 \r");
+                if (digits == std::string::npos || digits + 1 >= line.size())
+                    continue;
+                int64_t value = std::strtoll(line.c_str() + digits + 1, nullptr, 10);
+                if (tea::starts_with(line, "cache hit (")) {
+                    stats.hits += value;
+                    found = true;
+                } else if (tea::starts_with(line, "cache miss")) {
+                    stats.misses += value;
+                    found = true;
+                }
+            }
+            return found;
+        }
+
+        int64_t sum_counts(const nlohmann::json& json) {
+            if (json.is_number_integer())
+                return json.get<int64_t>();
+            // newer versions count per language
+            int64_t sum = 0;
+            if (json.is_object() && json.contains("counts")) {
+                for (auto& count : json["counts"]) {
+                    if (count.is_number_integer())
+                        sum += count.get<int64_t>();
+                }
+            }
+            return sum;
+        }
+
+        bool read_sccache_stats(const std::string& program, CompilerCacheStats& stats) {
+            std::string output = output_of({program, "--show-stats", "--stats-format=json"});
+            auto json = nlohmann::json::parse(output, nullptr, false);
+            if (!json.is_object() || !json.contains("stats"))
+                return false;
+            auto& counters = json["stats"];
+            stats = {};
+            if (counters.contains("cache_hits"))
+                stats.hits = sum_counts(counters["cache_hits"]);
+            if (counters.contains("cache_misses"))
+                stats.misses = sum_counts(counters["cache_misses"]);
+            return true;
+        }
+
+        bool is_compile(const InvocationUsage& usage) {
+            return usage.has_output && (ends_with(usage.name, ".o")
+                || ends_with(usage.name, ".obj"));
+        }
+    }
+
+    bool is_compiler_cache(const std::string& program) {
+        std::string name = program_name(program);
+        return name == "ccache" || name == "sccache";
+    }
+
+    std::string find_compiler_cache() {
+        std::string ccache = subprocess::find_program("ccache");
+        if (!ccache.empty() && ccache_is_local(ccache))
+            return ccache;
+        std::string sccache = subprocess::find_program("sccache");
+        if (!sccache.empty() && sccache_is_local())
+            return sccache;
+        return "";
+    }
+
+    bool read_compiler_cache_stats(const std::string& program, CompilerCacheStats& stats) {
+        if (program_name(program) == "sccache")
+            return read_sccache_stats(program, stats);
+        return read_ccache_stats(program, stats);
+    }
+
+    std::string compiler_cache_report(BuildStore& store, const CompilerCacheStats& before,
+            const CompilerCacheStats& after, const std::vector<InvocationUsage>& usages) {
+        int64_t hits    = after.hits - before.hits;
+        int64_t misses  = after.misses - before.misses;
+        // the stats are shared, a concurrent build may have zeroed them
+        if (hits < 0 || misses < 0 || hits + misses == 0)
+            return "";
+
+        std::string result = "[compiler cache] " + std::to_string(hits) + " of "
+            + std::to_string(hits + misses) + " compiles hit ("
+            + nice_num(100.0*hits/(hits + misses)) + "%)";
+
+        std::vector<double> seconds;
+        for (auto& usage : usages) {
+            if (is_compile(usage))
+                seconds.push_back(usage.cpu_seconds);
+        }
+        std::sort(seconds.begin(), seconds.end(), std::greater<double>());
+        size_t miss_count = std::min<size_t>(misses, seconds.size());
+        double miss_seconds = 0;
+        double hit_seconds = 0;
+        for (size_t i = 0; i < seconds.size(); ++i)
+            (i < miss_count? miss_seconds : hit_seconds) += seconds[i];
+
+        double per_compile = 0;
+        if (miss_count > 0) {
+            per_compile = miss_seconds/miss_count;
+            store.set(kCompileSecondsKey, std::to_string(per_compile));
+        } else {
+            per_compile = std::strtod(store.get(kCompileSecondsKey).c_str(), nullptr);
+        }
+        if (per_compile > 0 && !seconds.empty()) {
+            double saved = hits*per_compile - hit_seconds;
+            if (saved > 0)
+                result += ", saved about " + nice_time(saved) + " cpu";
+        }
+        return result;
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ResourceMonitor.hpp"
+
+namespace buildhl {
+    class BuildStore;
+
+    /** Hit and miss counters of ccache or sccache. */
+    struct CompilerCacheStats {
+        int64_t hits    = 0;
+        int64_t misses  = 0;
+    };
+
+    /** @return ccache or sccache from PATH if it only uses a local cache
+                directory, else empty.
+    */
+    std::string find_compiler_cache();
+
+    /** @return whether program is ccache or sccache */
+    bool is_compiler_cache(const std::string& program);
+
+    /** Reads the counters of the cache, they are never zeroed so the
+        user's own statistics stay intact.
+
+        @return false if the program failed or its output wasn't understood
+    */
+    bool read_compiler_cache_stats(const std::string& program, CompilerCacheStats& stats);
+
+    /** Summarizes the hits and misses between two snapshots.
+
+        The time saved is estimated from the cpu time of the slowest
+        compiles, these are taken to be the misses. If this build had no
+        misses the average from a previous build is used.
+
+        @return the line for the build summary, empty if nothing compiled
+    */
+    std::string compiler_cache_report(BuildStore& store, const CompilerCacheStats& before,
+        const CompilerCacheStats& after, const std::vector<InvocationUsage>& usages);
+}
@@ -0,0 +1,156 @@
+#include "fast_linker.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <unordered_set>
+
+#include <subprocess.hpp>
+#include <teaport_utils/fileutils.hpp>
+#include <teaport_utils/stringutils.hpp>
+
+#include "BuildStore.hpp"
+#include "highlight.hpp"
+#include "ninja_files.hpp"
+
+namespace buildhl {
+    namespace {
+        /** how many of the longest link steps to list */
+        const size_t kReportedLinkSteps = 3;
+
+        bool run_quiet(const std::vector<std::string>& command, const std::string& cwd="",
+                std::string* output=nullptr) {
+            try {
+                auto process = subprocess::RunBuilder(command)
+                    .cwd(cwd)
+                    .cout(subprocess::PipeOption::pipe)
+                    .cerr(subprocess::PipeOption::cout)
+                    .run();
+                if (output != nullptr)
+                    *output = process.cout;
+                return (bool)process;
+            } catch (std::exception&) {
+                return false;
+            }
+        }
+
+        /** compiler id the way cmake names it, from --version */
+        std::string compiler_id(const std::string& compiler) {
+            std::string output;
+            if (!run_quiet({compiler, "--version"}, "", &output))
+                return "";
+            if (output.find("clang") != std::string::npos)
+                return "Clang";
+            if (output.find("Free Software Foundation") != std::string::npos)
+                return "GNU";
+            return "";
+        }
+
+        bool try_link(const std::string& compiler, const std::string& linker,
+                const std::string& probe_dir) {
+            tea::mkdir_p(probe_dir);
+            tea::file_put_contents(tea::join_path(probe_dir, "main.cpp"), "int main() { return 0; }\n");
+            return run_quiet({compiler, "-fuse-ld=" + linker, "main.cpp", "-o", "main"}, probe_dir);
+        }
+
+        /** @return major*100 + minor of cmake on PATH, 0 if unknown */
+        int cmake_version() {
+            std::string output;
+            if (!run_quiet({"cmake", "--version"}, "", &output))
+                return 0;
+            int major = 0, minor = 0;
+            if (sscanf(output.c_str(), "cmake version %d.%d", &major, &minor) != 2)
+                return 0;
+            return major*100 + minor;
+        }
+
+        bool is_object(const std::string& name) {
+            for (const char* ext : {".o", ".obj"}) {
+                size_t size = strlen(ext);
+                if (name.size() >= size && name.compare(name.size() - size, size, ext) == 0)
+                    return true;
+            }
+            return false;
+        }
+    }
+
+    std::string find_fast_linker(BuildStore* store, const std::string& compiler,
+            const std::string& probe_dir) {
+        std::string key = "fast_linker:" + compiler;
+        if (store != nullptr && store->is_open()) {
+            std::string cached = store->get(key);
+            if (!cached.empty())
+                return cached == "none"? "" : cached;
+        }
+
+        std::string result;
+        std::string id = compiler_id(compiler);
+        if (id == "GNU" || id == "Clang") {
+            // gcc looks for ld.mold and ld.lld next to its own ld or on PATH
+            if (!subprocess::find_program("mold").empty() && try_link(compiler, "mold", probe_dir))
+                result = "mold";
+            else if (!subprocess::find_program("ld.lld").empty() && try_link(compiler, "lld", probe_dir))
+                result = "lld";
+        }
+        std::error_code ec;
+        std::filesystem::remove_all(probe_dir, ec);
+        if (store != nullptr && store->is_open())
+            store->set(key, result.empty()? "none" : result);
+        return result;
+    }
+
+    std::vector<std::string> fast_linker_arguments(const std::string& linker) {
+        if (linker.empty())
+            return {};
+        if (cmake_version() >= 329) {
+            std::string type = linker == "mold"? "MOLD" : "LLD";
+            return {"-DCMAKE_LINKER_TYPE=" + type};
+        }
+        std::vector<std::string> result;
+        for (const char* kind : {"EXE", "SHARED", "MODULE"})
+            result.push_back(std::string("-DCMAKE_") + kind + "_LINKER_FLAGS_INIT=-fuse-ld=" + linker);
+        return result;
+    }
+
+    std::vector<LinkStep> ninja_link_steps(const std::string& build_dir, int64_t offset) {
+        auto outputs = ninja_link_outputs(build_dir);
+        std::unordered_set<std::string> links(outputs.begin(), outputs.end());
+        std::vector<LinkStep> steps;
+        for (auto& entry : load_ninja_log(build_dir, offset)) {
+            if (links.count(entry.output))
+                steps.push_back({entry.output, entry.seconds()});
+        }
+        return steps;
+    }
+
+    std::vector<LinkStep> monitored_link_steps(const std::vector<InvocationUsage>& usages) {
+        std::vector<LinkStep> steps;
+        for (auto& usage : usages) {
+            // cmTC_ are the try_compile checks of configure
+            if (!usage.has_output || is_object(usage.name) || usage.name.find("cmTC_") != std::string::npos)
+                continue;
+            // seen by a single sample, it took less than the interval
+            double seconds = usage.wall_seconds > 0? usage.wall_seconds : usage.cpu_seconds;
+            steps.push_back({usage.name, seconds});
+        }
+        return steps;
+    }
+
+    std::vector<std::string> link_report(std::vector<LinkStep> steps, const std::string& linker) {
+        if (steps.empty())
+            return {};
+        std::sort(steps.begin(), steps.end(), [](const LinkStep& a, const LinkStep& b) {
+            return a.seconds > b.seconds;
+        });
+        double total = 0;
+        for (auto& step : steps)
+            total += step.seconds;
+        std::vector<std::string> lines;
+        lines.push_back("[link] " + std::to_string(steps.size()) + " link steps took "
+            + nice_time(total) + " with " + (linker.empty()? "the default linker" : linker));
+        for (size_t i = 0; i < steps.size() && i < kReportedLinkSteps; ++i)
+            lines.push_back("    " + nice_time(steps[i].seconds) + " " + steps[i].output);
+        return lines;
+    }
+}
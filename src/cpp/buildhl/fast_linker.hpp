@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "ResourceMonitor.hpp"
+
+namespace buildhl {
+    class BuildStore;
+
+    /** Finds mold or lld and checks compiler can link with it.
+
+        The result of the try-link is kept in the store per compiler, so
+        later configures of the same build dir don't compile anything.
+
+        @param probe_dir    scratch directory for the test program
+        @return "mold", "lld" or empty if neither works
+    */
+    std::string find_fast_linker(BuildStore* store, const std::string& compiler,
+        const std::string& probe_dir);
+
+    /** cmake arguments that make it link with linker. CMAKE_LINKER_TYPE on
+        cmake 3.29 and up, else -fuse-ld= in the linker flags cmake
+        initializes its cache with, so LDFLAGS keeps working.
+    */
+    std::vector<std::string> fast_linker_arguments(const std::string& linker);
+
+    struct LinkStep {
+        std::string output;
+        double      seconds = 0;
+    };
+
+    /** Link steps ninja logged after offset, see load_ninja_log(). */
+    std::vector<LinkStep> ninja_link_steps(const std::string& build_dir, int64_t offset);
+    /** Link steps the resource monitor saw, invocations whose output isn't
+        an object file. Durations are only as precise as the sampling.
+    */
+    std::vector<LinkStep> monitored_link_steps(const std::vector<InvocationUsage>& usages);
+
+    /** @return lines for the build summary with the longest link steps */
+    std::vector<std::string> link_report(std::vector<LinkStep> steps, const std::string& linker);
+}
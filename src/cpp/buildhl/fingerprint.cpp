@@ -0,0 +1,296 @@
+#include "fingerprint.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+#include <teaport_utils/fileutils.hpp>
+
+#include "MappedFile.hpp"
+
+namespace fs = std::filesystem;
+
+namespace buildhl {
+    namespace {
+        constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+        constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4Full;
+        constexpr uint64_t kPrime3 = 0x165667B19E3779F9ull;
+
+        uint64_t rotl(uint64_t value, int bits) {
+            return (value << bits) | (value >> (64 - bits));
+        }
+        uint64_t read_u64(const unsigned char* data) {
+            uint64_t value;
+            std::memcpy(&value, data, sizeof(value));
+            return value;
+        }
+        uint64_t mix(uint64_t acc, uint64_t input) {
+            acc += input*kPrime2;
+            return rotl(acc, 31)*kPrime1;
+        }
+        uint64_t avalanche(uint64_t hash) {
+            hash ^= hash >> 33;
+            hash *= kPrime2;
+            hash ^= hash >> 29;
+            hash *= kPrime3;
+            hash ^= hash >> 32;
+            return hash;
+        }
+    }
+
+    // four independent lanes over 32 byte blocks, xxhash64 style
+    uint64_t hash64(const void* data_in, size_t size, uint64_t seed) {
+        const unsigned char* data = static_cast<const unsigned char*>(data_in);
+        const unsigned char* end = data + size;
+        uint64_t hash;
+        if (size >= 32) {
+            uint64_t lanes[4] = {seed + kPrime1 + kPrime2, seed + kPrime2, seed, seed - kPrime1};
+            for (; data + 32 <= end; data += 32) {
+                for (int i = 0; i < 4; ++i)
+                    lanes[i] = mix(lanes[i], read_u64(data + i*8));
+            }
+            hash = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+            for (uint64_t lane : lanes)
+                hash = (hash ^ mix(0, lane))*kPrime1 + kPrime3;
+        } else {
+            hash = seed + kPrime3;
+        }
+        hash += size;
+        for (; data + 8 <= end; data += 8)
+            hash = rotl(hash ^ mix(0, read_u64(data)), 27)*kPrime1 + kPrime3;
+        for (; data < end; ++data)
+            hash = rotl(hash ^ (*data*kPrime3), 11)*kPrime1;
+        return avalanche(hash);
+    }
+
+    void FileFingerprints::load(const std::string& data) {
+        m_entries.clear();
+        m_combined  = 0;
+        m_dirty     = false;
+        std::istringstream input(data);
+        input >> m_combined;
+        Entry entry;
+        while (input >> entry.mtime >> entry.size >> entry.hash) {
+            input.get();
+            if (!std::getline(input, entry.path))
+                break;
+            m_entries.push_back(entry);
+        }
+    }
+
+    std::string FileFingerprints::serialize() const {
+        std::string result = std::to_string(m_combined) + "\n";
+        for (auto& entry : m_entries) {
+            result += std::to_string(entry.mtime) + " " + std::to_string(entry.size) + " "
+                + std::to_string(entry.hash) + " " + entry.path + "\n";
+        }
+        return result;
+    }
+
+    uint64_t FileFingerprints::update(std::vector<std::string> files) {
+        std::sort(files.begin(), files.end());
+        files.erase(std::unique(files.begin(), files.end()), files.end());
+
+        std::unordered_map<std::string, size_t> old_index;
+        for (size_t i = 0; i < m_entries.size(); ++i)
+            old_index[m_entries[i].path] = i;
+
+        std::vector<Entry> entries(files.size());
+        std::vector<size_t> stale;
+        for (size_t i = 0; i < files.size(); ++i) {
+            Entry& entry = entries[i];
+            entry.path = files[i];
+            std::error_code ec;
+            auto mtime = fs::last_write_time(entry.path, ec);
+            if (!ec)
+                entry.size = fs::file_size(entry.path, ec);
+            if (ec) {
+                entry.size = -1;
+            } else {
+                entry.mtime = mtime.time_since_epoch().count();
+            }
+            auto it = old_index.find(entry.path);
+            if (it != old_index.end()) {
+                const Entry& old = m_entries[it->second];
+                if (old.mtime == entry.mtime && old.size == entry.size) {
+                    entry.hash = old.hash;
+                    continue;
+                }
+            }
+            if (entry.size >= 0)
+                stale.push_back(i);
+        }
+
+        int thread_count = std::max(1u, std::thread::hardware_concurrency());
+        thread_count = std::min<int>(thread_count, stale.size());
+        std::atomic<size_t> next{0};
+        auto worker = [&]() {
+            while (true) {
+                size_t index = next++;
+                if (index >= stale.size())
+                    break;
+                Entry& entry = entries[stale[index]];
+                MappedFile file(entry.path);
+                entry.hash = file? hash64(file.data(), file.size()) : 0;
+            }
+        };
+        // a thread costs more than hashing a few small files
+        if (stale.size() < 8) {
+            worker();
+        } else {
+            std::vector<std::thread> threads;
+            for (int i = 0; i < thread_count; ++i)
+                threads.emplace_back(worker);
+            for (auto& thread : threads)
+                thread.join();
+        }
+
+        uint64_t combined = 0;
+        for (auto& entry : entries) {
+            combined = hash64(entry.path.data(), entry.path.size(), combined);
+            combined = hash64(&entry.hash, sizeof(entry.hash), combined);
+        }
+        bool changed_stats = entries.size() != m_entries.size() || !stale.empty();
+        for (size_t i = 0; i < entries.size() && !changed_stats; ++i)
+            changed_stats = entries[i].mtime != m_entries[i].mtime || entries[i].path != m_entries[i].path;
+        m_dirty     = changed_stats || combined != m_combined;
+        m_entries   = std::move(entries);
+        m_combined  = combined;
+        return combined;
+    }
+
+    namespace {
+        /** "a" "b" strings inside set(name ...) of CMakeFiles/Makefile.cmake.
+            Paths may have ")" in them, cmake escapes \ " and $ with a \.
+        */
+        std::vector<std::string> makefile_set(std::string_view data, const std::string& name) {
+            size_t pos = data.find("set(" + name + "\n");
+            if (pos == std::string_view::npos)
+                return {};
+            pos += name.size() + 5;
+            std::vector<std::string> result;
+            while (true) {
+                while (pos < data.size() && (data[pos] == ' ' || data[pos] == '\n' || data[pos] == '\r'))
+                    ++pos;
+                if (pos >= data.size() || data[pos] != '"')
+                    break;
+                std::string entry;
+                for (++pos; pos < data.size() && data[pos] != '"'; ++pos) {
+                    if (data[pos] == '\\' && pos + 1 < data.size())
+                        ++pos;
+                    entry += data[pos];
+                }
+                if (pos >= data.size())
+                    break;
+                ++pos;
+                result.push_back(std::move(entry));
+            }
+            return result;
+        }
+
+        /** "build outputs: RERUN_CMAKE | inputs" of build.ninja */
+        void ninja_rerun_edge(std::string_view data, std::vector<std::string>* outputs,
+                std::vector<std::string>* inputs) {
+            size_t pos = data.find(": RERUN_CMAKE");
+            if (pos == std::string_view::npos)
+                return;
+            pos = data.rfind("\nbuild ", pos);
+            if (pos == std::string_view::npos)
+                return;
+            pos += strlen("\nbuild ");
+            std::string path;
+            enum { kOutputs, kRule, kExplicit, kImplicit } part = kOutputs;
+            for (; pos < data.size(); ++pos) {
+                char ch = data[pos];
+                if (ch == '$' && pos + 1 < data.size()) {
+                    char next = data[++pos];
+                    if (next == '\n') {
+                        // line continuation, skip the indent of the next line
+                        while (pos + 1 < data.size() && data[pos+1] == ' ')
+                            ++pos;
+                        ch = ' ';
+                    } else {
+                        path += next;
+                        continue;
+                    }
+                }
+                if (ch == ':' && part == kOutputs) {
+                    if (!path.empty() && outputs != nullptr)
+                        outputs->push_back(path);
+                    path.clear();
+                    part = kRule;
+                    continue;
+                }
+                if (ch == '\n' || ch == ' ') {
+                    if (path == "||")
+                        break;
+                    if (path == "|") {
+                        part = kImplicit;
+                    } else if (!path.empty() && part == kOutputs) {
+                        if (outputs != nullptr)
+                            outputs->push_back(path);
+                    } else if (!path.empty() && part == kRule) {
+                        part = kExplicit;
+                    } else if (!path.empty() && inputs != nullptr) {
+                        inputs->push_back(path);
+                    }
+                    path.clear();
+                    if (ch == '\n')
+                        break;
+                    continue;
+                }
+                path += ch;
+            }
+        }
+
+        /** Ninja Multi-Config puts the edge in CMakeFiles/common.ninja */
+        void ninja_rerun_files(const std::string& build_dir, std::vector<std::string>* outputs,
+                std::vector<std::string>* inputs) {
+            for (const char* name : {"build.ninja", "CMakeFiles/common.ninja"}) {
+                MappedFile ninja(tea::join_path(build_dir, name));
+                if (!ninja)
+                    continue;
+                ninja_rerun_edge(ninja.view(), outputs, inputs);
+                if ((outputs != nullptr && !outputs->empty()) || (inputs != nullptr && !inputs->empty()))
+                    return;
+            }
+        }
+
+        void make_absolute(const std::string& build_dir, std::vector<std::string>& files) {
+            for (auto& file : files) {
+                // tea::join_path refuses a ':' which ninja paths may escape
+                if (!fs::path(file).is_absolute())
+                    file = (fs::path(build_dir) / file).string();
+            }
+        }
+    }
+
+    std::vector<std::string> cmake_input_files(const std::string& build_dir) {
+        std::vector<std::string> files;
+        MappedFile makefile(tea::join_path(build_dir, "CMakeFiles/Makefile.cmake"));
+        if (makefile)
+            files = makefile_set(makefile.view(), "CMAKE_MAKEFILE_DEPENDS");
+        if (files.empty())
+            ninja_rerun_files(build_dir, nullptr, &files);
+        make_absolute(build_dir, files);
+        return files;
+    }
+
+    std::vector<std::string> cmake_output_files(const std::string& build_dir) {
+        std::vector<std::string> files;
+        MappedFile makefile(tea::join_path(build_dir, "CMakeFiles/Makefile.cmake"));
+        if (makefile) {
+            files = makefile_set(makefile.view(), "CMAKE_MAKEFILE_OUTPUTS");
+            for (auto& file : makefile_set(makefile.view(), "CMAKE_MAKEFILE_PRODUCTS"))
+                files.push_back(file);
+        }
+        if (files.empty())
+            ninja_rerun_files(build_dir, &files, nullptr);
+        make_absolute(build_dir, files);
+        return files;
+    }
+}
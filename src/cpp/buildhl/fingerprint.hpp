@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace buildhl {
+    /** Fast non cryptographic 64 bit hash. */
+    uint64_t hash64(const void* data, size_t size, uint64_t seed=0);
+
+    /** Content hashes of a set of files.
+
+        A file is only read again when its size or mtime changed, so
+        checking a set of unchanged files costs a stat per file.
+    */
+    class FileFingerprints {
+    public:
+        /** @param data what serialize() returned, may be empty */
+        void load(const std::string& data);
+        std::string serialize() const;
+
+        /** Rehashes the files that changed, in parallel.
+
+            Files not in the list are forgotten, missing files hash to 0.
+            @return the combined hash of all files
+        */
+        uint64_t update(std::vector<std::string> files);
+
+        /** combined hash as of the last load() or update() */
+        uint64_t combined() const { return m_combined; }
+        /** update() changed anything that needs saving */
+        bool dirty() const { return m_dirty; }
+    private:
+        struct Entry {
+            std::string path;
+            int64_t     mtime   = 0;
+            int64_t     size    = -1;
+            uint64_t    hash    = 0;
+        };
+        std::vector<Entry>  m_entries;
+        uint64_t            m_combined  = 0;
+        bool                m_dirty     = false;
+    };
+
+    /** Files cmake reads to generate the build dir.
+
+        Taken from CMAKE_MAKEFILE_DEPENDS in CMakeFiles/Makefile.cmake or the
+        inputs of the RERUN_CMAKE edge in build.ninja, or in
+        CMakeFiles/common.ninja for Ninja Multi-Config. Empty if neither
+        could be found.
+    */
+    std::vector<std::string> cmake_input_files(const std::string& build_dir);
+
+    /** Files cmake generates that the build tool checks against the inputs
+        to decide if cmake needs to run again.
+    */
+    std::vector<std::string> cmake_output_files(const std::string& build_dir);
+}
@@ -243,4 +243,14 @@ namespace buildhl {
         double min = seconds/60;
         return prefix + nice_num(min) + " min";
     }
+    std::string nice_bytes(int64_t bytes) {
+        const char* units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+        double value = bytes;
+        int unit = 0;
+        while (value >= 1024 && unit < 4) {
+            value /= 1024;
+            ++unit;
+        }
+        return nice_num(value) + " " + units[unit];
+    }
 }
\ No newline at end of file
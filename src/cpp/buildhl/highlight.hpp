@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 
 #include "lexer.hpp"
@@ -24,5 +25,7 @@ std::vector<lex::Range> tokenize(lex::StaticString line);
 std::string color_line(std::string line);
 
 namespace buildhl {
+    std::string nice_num(double num);
     std::string nice_time(double seconds);
+    std::string nice_bytes(int64_t bytes);
 }
\ No newline at end of file
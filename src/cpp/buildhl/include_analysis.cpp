@@ -0,0 +1,84 @@
+#include "include_analysis.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <unordered_map>
+
+#include "highlight.hpp"
+#include "ninja_files.hpp"
+
+namespace fs = std::filesystem;
+
+namespace buildhl {
+    namespace {
+        bool is_source_file(std::string_view path) {
+            size_t dot = path.rfind('.');
+            if (dot == std::string_view::npos)
+                return false;
+            std::string_view ext = path.substr(dot + 1);
+            for (const char* source_ext : {"c", "cc", "cpp", "cxx", "c++", "C", "m", "mm", "cu"}) {
+                if (ext == source_ext)
+                    return true;
+            }
+            return false;
+        }
+    }
+
+    std::vector<HeaderCost> analyze_includes(const std::string& build_dir, const std::string& ninja) {
+        NinjaDeps deps;
+        if (!deps.load(build_dir, ninja))
+            return {};
+        auto log = load_ninja_log(build_dir);
+        std::unordered_map<std::string_view, double> compile_seconds;
+        compile_seconds.reserve(log.size());
+        for (auto& entry : log) {
+            compile_seconds[entry.output] = entry.seconds();
+        }
+
+        auto& paths = deps.paths();
+        std::vector<double> seconds(paths.size(), 0);
+        std::vector<int> counts(paths.size(), 0);
+        for (auto& record : deps.records()) {
+            double cost = 0;
+            auto it = compile_seconds.find(paths[record.output]);
+            if (it != compile_seconds.end())
+                cost = it->second;
+            for (int i = 0; i < record.count; ++i) {
+                int input = record.inputs[i];
+                seconds[input] += cost;
+                ++counts[input];
+            }
+        }
+
+        std::vector<HeaderCost> result;
+        for (size_t id = 0; id < paths.size(); ++id) {
+            if (counts[id] == 0 || is_source_file(paths[id]))
+                continue;
+            HeaderCost cost;
+            fs::path path(std::string(paths[id]));
+            if (path.is_relative())
+                path = fs::path(build_dir) / path;
+            cost.path       = path.lexically_normal().string();
+            cost.count      = counts[id];
+            cost.seconds    = seconds[id];
+            result.push_back(std::move(cost));
+        }
+        std::sort(result.begin(), result.end(), [](const HeaderCost& a, const HeaderCost& b) {
+            if (a.seconds != b.seconds)
+                return a.seconds > b.seconds;
+            return a.count > b.count;
+        });
+        return result;
+    }
+
+    std::vector<std::string> include_report(const std::vector<HeaderCost>& costs, int top) {
+        std::vector<std::string> lines;
+        lines.push_back("headers by rebuild cost, " + std::to_string(costs.size()) + " headers total");
+        for (int i = 0; i < top && i < (int)costs.size(); ++i) {
+            auto& cost = costs[i];
+            lines.push_back("    " + nice_time(cost.seconds) + " in "
+                + std::to_string(cost.count) + " TUs  " + cost.path);
+        }
+        return lines;
+    }
+}
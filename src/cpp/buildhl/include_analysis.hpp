@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace buildhl {
+    /** How expensive touching a header is for an incremental build */
+    struct HeaderCost {
+        std::string path;
+        /** translation units that include it */
+        int         count   = 0;
+        /** summed compile time of those translation units */
+        double      seconds = 0;
+    };
+
+    /** Combines .ninja_deps and .ninja_log of a ninja build dir.
+
+        @return headers sorted by rebuild cost, most expensive first.
+    */
+    std::vector<HeaderCost> analyze_includes(const std::string& build_dir, const std::string& ninja="ninja");
+
+    /** @return human readable report of the top headers */
+    std::vector<std::string> include_report(const std::vector<HeaderCost>& costs, int top=25);
+}
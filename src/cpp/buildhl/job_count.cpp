@@ -0,0 +1,67 @@
+#include "job_count.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "BuildStore.hpp"
+#include "highlight.hpp"
+#include "system_info.hpp"
+
+namespace buildhl {
+    namespace {
+        const char* kJobMemoryKey = "job_memory";
+        /** fewer invocations than this say nothing about the project */
+        const size_t kMinInvocations = 4;
+    }
+
+    std::string JobCount::to_string() const {
+        std::string result = std::to_string(jobs) + " jobs: " + std::to_string(cpus) + " cpus";
+        if (cpu_quota > 0)
+            result += ", cpu quota " + nice_num(cpu_quota);
+        if (available_memory >= 0) {
+            result += ", " + nice_bytes(available_memory) + " available / "
+                + nice_bytes(job_memory) + " per job (" + job_memory_source + ")";
+        }
+        return result;
+    }
+
+    JobCount decide_job_count(BuildStore& store, int64_t job_memory) {
+        JobCount count;
+        count.cpus          = cpu_count();
+        count.cpu_quota     = cpu_quota();
+        count.available_memory = available_memory();
+        if (job_memory > 0) {
+            count.job_memory        = job_memory;
+            count.job_memory_source = "BUILDHL_JOB_MEMORY";
+        } else {
+            std::string learned = store.get(kJobMemoryKey);
+            int64_t value = learned.empty()? 0 : std::strtoll(learned.c_str(), nullptr, 10);
+            if (value > 0) {
+                count.job_memory        = value;
+                count.job_memory_source = "learned";
+            }
+        }
+
+        int jobs = count.cpus;
+        if (count.cpu_quota > 0)
+            jobs = std::min(jobs, (int)std::ceil(count.cpu_quota));
+        if (count.available_memory >= 0)
+            jobs = std::min<int64_t>(jobs, count.available_memory/count.job_memory);
+        count.jobs = std::max(jobs, 1);
+        return count;
+    }
+
+    void learn_job_memory(BuildStore& store, const std::vector<InvocationUsage>& usages) {
+        std::vector<int64_t> peaks;
+        for (auto& usage : usages) {
+            if (usage.has_output && usage.peak_rss > 0)
+                peaks.push_back(usage.peak_rss);
+        }
+        if (peaks.size() < kMinInvocations)
+            return;
+        size_t index = peaks.size()*9/10;
+        std::nth_element(peaks.begin(), peaks.begin() + index, peaks.end());
+        store.set(kJobMemoryKey, std::to_string(peaks[index]));
+    }
+}
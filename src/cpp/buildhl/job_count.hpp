@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ResourceMonitor.hpp"
+
+namespace buildhl {
+    class BuildStore;
+
+    /** memory assumed per job when nothing better is known */
+    constexpr int64_t kDefaultJobMemory = 1024*1024*1024;
+
+    /** How many jobs to run and why. */
+    struct JobCount {
+        int         jobs            = 1;
+        int         cpus            = 0;
+        /** cgroup cpu quota in CPUs, -1 if none */
+        double      cpu_quota       = -1;
+        /** -1 if unknown */
+        int64_t     available_memory = -1;
+        int64_t     job_memory      = kDefaultJobMemory;
+        /** where job_memory came from: default, BUILDHL_JOB_MEMORY or learned */
+        std::string job_memory_source = "default";
+
+        /** the decision and its inputs for the build log */
+        std::string to_string() const;
+    };
+
+    /** Picks the number of jobs from the CPUs we may use, the cgroup quota
+        and the memory available divided by the memory per job.
+
+        @param job_memory   memory per job if configured, else 0 and the
+                            one learned from previous builds is used.
+    */
+    JobCount decide_job_count(BuildStore& store, int64_t job_memory);
+
+    /** Remembers the memory compiler invocations used for the next build.
+
+        Uses the 90th percentile of peak RSS of the invocations that had an
+        output, so a few outliers don't make every build slower.
+    */
+    void learn_job_memory(BuildStore& store, const std::vector<InvocationUsage>& usages);
+}
@@ -0,0 +1,292 @@
+#include "ninja_files.hpp"
+
+#include <cstring>
+#include <unordered_map>
+
+#include <subprocess.hpp>
+#include <teaport_utils/fileutils.hpp>
+
+namespace buildhl {
+    namespace {
+        std::string_view next_line(std::string_view& data) {
+            size_t end = data.find('\n');
+            std::string_view line = data.substr(0, end);
+            data.remove_prefix(end == std::string_view::npos? data.size() : end + 1);
+            return line;
+        }
+
+        std::string_view next_field(std::string_view& line) {
+            size_t end = line.find('\t');
+            std::string_view field = line.substr(0, end);
+            line.remove_prefix(end == std::string_view::npos? line.size() : end + 1);
+            return field;
+        }
+
+        bool parse_int(std::string_view str, int64_t& value) {
+            value = 0;
+            if (str.empty())
+                return false;
+            for (char ch : str) {
+                if (ch < '0' || ch > '9')
+                    return false;
+                value = value*10 + (ch - '0');
+            }
+            return true;
+        }
+
+        /** next path of a build or include line, unescaping $ sequences */
+        std::string next_path(std::string_view& line) {
+            while (!line.empty() && line[0] == ' ')
+                line.remove_prefix(1);
+            std::string path;
+            while (!line.empty()) {
+                char ch = line[0];
+                if (ch == ' ' || ch == ':')
+                    break;
+                if (ch == '$' && line.size() > 1) {
+                    line.remove_prefix(1);
+                    ch = line[0];
+                }
+                path += ch;
+                line.remove_prefix(1);
+            }
+            return path;
+        }
+
+        bool is_link_rule(std::string_view rule) {
+            return rule.find("_LINKER__") != std::string_view::npos
+                && rule.find("STATIC_LIBRARY") == std::string_view::npos;
+        }
+
+        void collect_link_outputs(const std::string& build_dir, const std::string& file,
+                std::vector<std::string>& outputs, int depth) {
+            MappedFile ninja(tea::join_path(build_dir, file));
+            if (!ninja || depth > 8)
+                return;
+            std::string_view data = ninja.view();
+            while (!data.empty()) {
+                std::string_view line = next_line(data);
+                if (line.substr(0, 8) == "include " || line.substr(0, 9) == "subninja ") {
+                    line.remove_prefix(line.find(' '));
+                    collect_link_outputs(build_dir, next_path(line), outputs, depth + 1);
+                    continue;
+                }
+                if (line.substr(0, 6) != "build ")
+                    continue;
+                line.remove_prefix(6);
+                std::vector<std::string> edge_outputs;
+                while (!line.empty() && line[0] != ':') {
+                    std::string path = next_path(line);
+                    if (!path.empty() && path != "|")
+                        edge_outputs.push_back(std::move(path));
+                }
+                if (line.empty())
+                    continue;
+                line.remove_prefix(1);
+                std::string rule = next_path(line);
+                if (is_link_rule(rule) && !edge_outputs.empty())
+                    outputs.push_back(edge_outputs[0]);
+            }
+        }
+
+        uint32_t read_u32(const char* data) {
+            uint32_t value;
+            std::memcpy(&value, data, sizeof(value));
+            return value;
+        }
+    }
+
+    std::vector<NinjaLogEntry> load_ninja_log(const std::string& build_dir, int64_t offset) {
+        MappedFile file(tea::join_path(build_dir, ".ninja_log"));
+        if (!file)
+            return {};
+        std::string_view data = file.view();
+        // log was recompacted, can't tell what is new anymore
+        if (offset > (int64_t)data.size())
+            offset = 0;
+        data.remove_prefix(offset);
+
+        std::vector<NinjaLogEntry> result;
+        std::unordered_map<std::string_view, size_t> index_of;
+        while (!data.empty()) {
+            std::string_view line = next_line(data);
+            if (line.empty() || line[0] == '#')
+                continue;
+            NinjaLogEntry entry;
+            int64_t mtime;
+            if (!parse_int(next_field(line), entry.start_ms)
+                || !parse_int(next_field(line), entry.end_ms)
+                || !parse_int(next_field(line), mtime))
+                continue;
+            std::string_view output = next_field(line);
+            if (output.empty())
+                continue;
+            auto it = index_of.find(output);
+            if (it != index_of.end()) {
+                // a newer run of the same edge, move it to the end
+                result[it->second].output.clear();
+            }
+            entry.output = std::string(output);
+            index_of[output] = result.size();
+            result.push_back(std::move(entry));
+        }
+        std::vector<NinjaLogEntry> newest;
+        newest.reserve(index_of.size());
+        for (auto& entry : result) {
+            if (!entry.output.empty())
+                newest.push_back(std::move(entry));
+        }
+        return newest;
+    }
+
+    std::vector<std::string> ninja_link_outputs(const std::string& build_dir) {
+        std::vector<std::string> outputs;
+        collect_link_outputs(build_dir, "build.ninja", outputs, 0);
+        return outputs;
+    }
+
+    bool NinjaDeps::load(const std::string& build_dir, const std::string& ninja) {
+        m_paths.clear();
+        m_records.clear();
+        if (load_binary(tea::join_path(build_dir, ".ninja_deps")))
+            return true;
+        return load_tool(build_dir, ninja);
+    }
+
+    /*  Format as written by ninja's DepsLog, version 4:
+
+        "# ninjadeps\n" int32 version
+        records of uint32 size, high bit set for deps records:
+            path: path padded with 0 to 4 bytes, uint32 ~id
+            deps: int32 output id, uint64 mtime, int32 input ids...
+    */
+    bool NinjaDeps::load_binary(const std::string& path) {
+        if (!m_file.open(path))
+            return false;
+        const char signature[] = "# ninjadeps\n";
+        const size_t signature_size = sizeof(signature) - 1;
+        const char* data = m_file.data();
+        size_t size = m_file.size();
+        if (size < signature_size + 4 || std::memcmp(data, signature, signature_size) != 0)
+            return false;
+        if (read_u32(data + signature_size) != 4)
+            return false;
+
+        std::vector<Record> all;
+        size_t pos = signature_size + 4;
+        while (pos + 4 <= size) {
+            uint32_t header = read_u32(data + pos);
+            bool is_deps = header & 0x80000000u;
+            size_t record_size = header & 0x7FFFFFFFu;
+            pos += 4;
+            // a partially written record at the end is ignored like ninja does
+            if (record_size % 4 != 0 || pos + record_size > size)
+                break;
+            const char* record = data + pos;
+            if (is_deps) {
+                if (record_size < 12)
+                    break;
+                Record deps;
+                deps.output = (int32_t)read_u32(record);
+                deps.inputs = reinterpret_cast<const int32_t*>(record + 12);
+                deps.count  = (record_size - 12)/4;
+                all.push_back(deps);
+            } else {
+                if (record_size < 8)
+                    break;
+                size_t path_size = record_size - 4;
+                for (int i = 0; i < 3 && record[path_size-1] == '\0'; ++i)
+                    --path_size;
+                uint32_t checksum = read_u32(record + record_size - 4);
+                if ((int)~checksum != (int)m_paths.size())
+                    break;
+                m_paths.emplace_back(record, path_size);
+            }
+            pos += record_size;
+        }
+        keep_newest(all);
+        return true;
+    }
+
+    /*  output of `ninja -t deps` looks like
+
+        CMakeFiles/foo.dir/foo.cpp.o: #deps 2, deps mtime 123 (VALID)
+            ../../foo.cpp
+            ../../foo.hpp
+    */
+    bool NinjaDeps::load_tool(const std::string& build_dir, const std::string& ninja) {
+        if (subprocess::find_program(ninja).empty())
+            return false;
+        try {
+            m_tool_output = subprocess::RunBuilder({ninja, "-C", build_dir, "-t", "deps"})
+                .cout(subprocess::PipeOption::pipe)
+                .cerr(subprocess::PipeOption::pipe)
+                .run().cout;
+        } catch (subprocess::SubprocessError&) {
+            return false;
+        }
+        std::unordered_map<std::string_view, int> ids;
+        auto id_of = [&](std::string_view path) {
+            auto it = ids.find(path);
+            if (it != ids.end())
+                return it->second;
+            int id = m_paths.size();
+            m_paths.push_back(path);
+            ids[path] = id;
+            return id;
+        };
+        // offsets into m_tool_inputs, turned into pointers once it stops growing
+        std::vector<std::pair<int, size_t>> outputs;
+        std::string_view data = m_tool_output;
+        while (!data.empty()) {
+            std::string_view line = next_line(data);
+            if (!line.empty() && line.back() == '\r')
+                line.remove_suffix(1);
+            if (line.empty())
+                continue;
+            if (line[0] == ' ' || line[0] == '\t') {
+                if (outputs.empty())
+                    continue;
+                size_t start = line.find_first_not_of(" \t");
+                m_tool_inputs.push_back(id_of(line.substr(start)));
+                continue;
+            }
+            size_t colon = line.find(": #deps");
+            if (colon == std::string_view::npos)
+                continue;
+            outputs.push_back({id_of(line.substr(0, colon)), m_tool_inputs.size()});
+        }
+        std::vector<Record> all;
+        for (size_t i = 0; i < outputs.size(); ++i) {
+            size_t end = i + 1 < outputs.size()? outputs[i+1].second : m_tool_inputs.size();
+            Record record;
+            record.output   = outputs[i].first;
+            record.inputs   = m_tool_inputs.data() + outputs[i].second;
+            record.count    = end - outputs[i].second;
+            all.push_back(record);
+        }
+        keep_newest(all);
+        return true;
+    }
+
+    void NinjaDeps::keep_newest(std::vector<Record>& all) {
+        std::vector<int> newest(m_paths.size(), -1);
+        for (size_t i = 0; i < all.size(); ++i) {
+            int output = all[i].output;
+            if (output < 0 || output >= (int)newest.size())
+                continue;
+            newest[output] = i;
+        }
+        for (int index : newest) {
+            if (index < 0)
+                continue;
+            Record record = all[index];
+            // drop records referencing ids that don't exist, corrupt log
+            bool valid = true;
+            for (int i = 0; i < record.count && valid; ++i)
+                valid = record.inputs[i] >= 0 && record.inputs[i] < (int)m_paths.size();
+            if (valid)
+                m_records.push_back(record);
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "MappedFile.hpp"
+
+namespace buildhl {
+    /** One line of .ninja_log */
+    struct NinjaLogEntry {
+        int64_t     start_ms    = 0;
+        int64_t     end_ms      = 0;
+        std::string output;
+
+        double seconds() const { return (end_ms - start_ms)/1000.0; }
+    };
+
+    /** Loads .ninja_log keeping the newest entry of each output.
+
+        @param offset   byte offset to start reading from. Use the size of
+                        the log before a build to get only that builds edges.
+        @return entries in the order they were last written.
+    */
+    std::vector<NinjaLogEntry> load_ninja_log(const std::string& build_dir, int64_t offset=0);
+
+    /** Outputs of the build.ninja edges that link an executable or a
+        shared library, following include and subninja.
+
+        Relies on cmake's rule names, CXX_EXECUTABLE_LINKER__target_Config.
+    */
+    std::vector<std::string> ninja_link_outputs(const std::string& build_dir);
+
+    /** Dependencies ninja recorded from depfiles, .ninja_deps.
+
+        Loading maps the binary log and references paths in place so even
+        very large logs load fast. If the log is of an unknown version the
+        output of `ninja -t deps` is parsed instead.
+    */
+    class NinjaDeps {
+    public:
+        struct Record {
+            int             output  = -1;
+            const int32_t*  inputs  = nullptr;
+            int             count   = 0;
+        };
+
+        bool load(const std::string& build_dir, const std::string& ninja="ninja");
+
+        /** node id to path as written in the log, relative to build dir */
+        const std::vector<std::string_view>& paths() const { return m_paths; }
+        /** the newest record of each output that has deps */
+        const std::vector<Record>& records() const { return m_records; }
+    private:
+        bool load_binary(const std::string& file);
+        bool load_tool(const std::string& build_dir, const std::string& ninja);
+        void keep_newest(std::vector<Record>& all);
+
+        MappedFile                      m_file;
+        std::string                     m_tool_output;
+        std::vector<int32_t>            m_tool_inputs;
+        std::vector<std::string_view>   m_paths;
+        std::vector<Record>             m_records;
+    };
+}
@@ -1,12 +1,26 @@
 #include "project_detect.hpp"
 
 #include <subprocess.hpp>
+#include <algorithm>
+#include <cstring>
 #include <filesystem>
 #include <teaport_utils/fileutils.hpp>
 #include <teaport_utils/stringutils.hpp>
 #include <teaport_utils/shell.hpp>
+#ifndef _WIN32
+#include <poll.h>
+#include <unistd.h>
+#endif
 
 #include "lexer.hpp"
+#include "ProgressAnalyser.hpp"
+#include "time_trace.hpp"
+#include "system_info.hpp"
+#include "fingerprint.hpp"
+#include "BuildStore.hpp"
+#include "MappedFile.hpp"
+#include "fast_linker.hpp"
+#include "test_runner.hpp"
 
 namespace fs = std::filesystem;
 
@@ -20,12 +34,44 @@ namespace buildhl {
         return "release";
     }
 
+    std::string cmake_build_type(BuildType build_type) {
+        switch (build_type) {
+        case BuildType::debug:      return "Debug";
+        case BuildType::release:    return "Release";
+        default:                    return "Release";
+        }
+    }
+
     InvocationInfo parse_args(std::vector<std::string> args) {
         InvocationInfo invocation;
         if (!subprocess::cenv["BUILDHL_MAX_JOBS"].to_string().empty()) {
             invocation.max_jobs = std::stoi(subprocess::cenv["BUILDHL_MAX_JOBS"]);
         }
         invocation.project_dir = subprocess::getcwd();
+        std::string time_trace = subprocess::cenv["BUILDHL_TIME_TRACE"];
+        invocation.time_trace = !time_trace.empty() && time_trace != "0";
+        std::string monitor_interval = subprocess::cenv["BUILDHL_MONITOR_INTERVAL"];
+        if (!monitor_interval.empty())
+            invocation.monitor_interval = std::stod(monitor_interval);
+        std::string direct_build = subprocess::cenv["BUILDHL_DIRECT_BUILD"];
+        invocation.direct_build = direct_build != "0";
+        invocation.compiler_cache = subprocess::cenv["BUILDHL_COMPILER_CACHE"].to_string() != "0";
+        std::string concurrent = subprocess::cenv["BUILDHL_CONCURRENT"];
+        invocation.concurrent = !concurrent.empty() && concurrent != "0";
+        std::string multi_config = subprocess::cenv["BUILDHL_MULTI_CONFIG"];
+        invocation.multi_config = !multi_config.empty() && multi_config != "0";
+        invocation.ctest = subprocess::cenv["BUILDHL_CTEST"].to_string() != "0";
+        std::string fast_linker = subprocess::cenv["BUILDHL_FAST_LINKER"];
+        invocation.fast_linker = !fast_linker.empty() && fast_linker != "0";
+        std::string jobserver = subprocess::cenv["BUILDHL_JOBSERVER"];
+        invocation.jobserver = !jobserver.empty() && jobserver != "0";
+        std::string job_memory = subprocess::cenv["BUILDHL_JOB_MEMORY"];
+        if (parse_bytes(job_memory) > 0)
+            invocation.job_memory = parse_bytes(job_memory);
+        std::string pty = subprocess::cenv["BUILDHL_PTY"];
+        invocation.pty = !pty.empty() && pty != "0";
+        std::string strip_input_colors = subprocess::cenv["BUILDHL_STRIP_INPUT_COLORS"];
+        invocation.strip_input_colors = !strip_input_colors.empty() && strip_input_colors != "0";
 
         for (size_t i = 0; i < args.size(); ++i) {
             if (args[i] == "--build") {
@@ -36,24 +82,71 @@ namespace buildhl {
                 ++i;
             } else if (args[i] == "--target") {
                 invocation.target = args[i+1];
+                invocation.targets.push_back(args[i+1]);
                 ++i;
+            } else if (args[i] == "--time-trace") {
+                invocation.time_trace = true;
+            } else if (args[i] == "--analyze-includes") {
+                invocation.analyze_includes = true;
+            } else if (args[i] == "--jobserver") {
+                invocation.jobserver = true;
+            } else if (args[i] == "--multi-config") {
+                invocation.multi_config = true;
+            } else if (args[i] == "--fast-linker") {
+                invocation.fast_linker = true;
+            } else if (args[i] == "--no-compiler-cache") {
+                invocation.compiler_cache = false;
+            } else if (args[i] == "--pty") {
+                invocation.pty = true;
+            } else if (args[i] == "--strip-input-colors") {
+                invocation.strip_input_colors = true;
+            } else if (args[i] == "--refresh-env") {
+                invocation.refresh_env = true;
+            } else if (args[i] == "--concurrent") {
+                invocation.concurrent = true;
             } else if (args[i] == "debug") {
                 invocation.build_type = BuildType::debug;
+                invocation.build_types.push_back(BuildType::debug);
             } else if (args[i] == "release") {
                 invocation.build_type = BuildType::release;
+                invocation.build_types.push_back(BuildType::release);
             } else if (args[i].substr(0, 2) == "-j") {
                 invocation.max_jobs = std::stoi(args[i].substr(2));
             } else if (args[i][0] == '-') {
                 invocation.configure_options.push_back(args[i]);
             } else {
                 invocation.target = args[i];
+                invocation.targets.push_back(args[i]);
             }
         }
         return invocation;
     }
 
+    std::vector<InvocationInfo> concurrent_invocations(const InvocationInfo& invocation) {
+        std::vector<BuildType> build_types = invocation.build_types;
+        if (build_types.empty())
+            build_types.push_back(invocation.build_type);
+        std::vector<std::string> targets = invocation.targets;
+        if (targets.empty())
+            targets.push_back(invocation.target);
+
+        std::vector<InvocationInfo> result;
+        for (auto build_type : build_types) {
+            for (auto& target : targets) {
+                InvocationInfo variant = invocation;
+                variant.build_type  = build_type;
+                variant.target      = target;
+                variant.build_types = {build_type};
+                variant.targets     = {target};
+                result.push_back(variant);
+            }
+        }
+        return result;
+    }
+
 
-    PopenInputStream_uptr popen_command(const CommandLine& command, const std::string& cwd="", subprocess::EnvMap env={}) {
+    subprocess::Popen popen_process(const CommandLine& command, const std::string& cwd="", const subprocess::EnvSnapshot& env={},
+            subprocess::PipeOption output=subprocess::PipeOption::pipe) {
         BlockSignalRaii bsr;
         // this makes compatibility on windows better. So you can have the same
         // script work on windows & other OS's
@@ -65,14 +158,60 @@ namespace buildhl {
         #endif
         auto builder = subprocess::RunBuilder(rcommand)
             .cwd(cwd)
-            .cout(subprocess::PipeOption::pipe).cerr(subprocess::PipeOption::cout);
+            .cout(output).cerr(subprocess::PipeOption::cout);
         if (!env.empty()) {
             builder.env(env);
         }
 
-        return std::make_unique<PopenInputStream>(builder.popen());
+        return builder.popen();
+    }
+
+    /** for replace_string_variables */
+    std::function<std::string(const std::string&)> env_lookup(const subprocess::EnvSnapshot& env) {
+        return [&env](const std::string& name) { return env.get(name); };
+    }
+
+    PopenInputStream_uptr popen_command(const CommandLine& command, const std::string& cwd="", const subprocess::EnvSnapshot& env={},
+            subprocess::PipeOption output=subprocess::PipeOption::pipe) {
+        return std::make_unique<PopenInputStream>(popen_process(command, cwd, env, output));
     }
 
+    PopenInputStream::Ready PopenInputStream::wait(double timeout) {
+#ifdef _WIN32
+        // reading blocks until there is output
+        return Ready::output;
+#else
+        struct pollfd fds[2] = {
+            {handle(), POLLIN, 0},
+            {mPopen.exit_handle(), POLLIN, 0}
+        };
+        int count = ::poll(fds, 2, std::max(0, (int)(timeout*1000.0)));
+        if (count < 0 && errno != EINTR)
+            return Ready::output;
+        if (fds[0].revents != 0)
+            return Ready::output;
+        // the exit handle may be shared by all children
+        if (fds[1].revents != 0 && mPopen.poll())
+            return Ready::exited;
+        return Ready::timeout;
+#endif
+    }
+
+    /** ctest's output, parsed for test results as it is read */
+    struct CTestInputStream : PopenInputStream {
+        CTestInputStream(subprocess::Popen&& popen, std::shared_ptr<CTestOutputParser> parser)
+            : PopenInputStream(std::move(popen)), mParser(parser) {
+        }
+        ssize_t read(void* buffer, size_t size) override {
+            ssize_t transfered = PopenInputStream::read(buffer, size);
+            if (transfered > 0)
+                mParser->feed(static_cast<const char*>(buffer), transfered);
+            return transfered;
+        }
+    private:
+        std::shared_ptr<CTestOutputParser> mParser;
+    };
+
     struct CFileInputStream : InputStream {
         CFileInputStream(FILE* fp) {mFile = fp;}
         ~CFileInputStream() {
@@ -93,7 +232,7 @@ namespace buildhl {
             ssize_t transfered = input.read(&buffer[0], buffer.size());
             if (transfered <= 0)
                 break;
-            result.insert(result.end(), buffer.begin(), buffer.begin() + buffer.size());
+            result.insert(result.end(), buffer.begin(), buffer.begin() + transfered);
         }
         return result;
     }
@@ -102,65 +241,128 @@ namespace buildhl {
         mBuildDir = build_dir;
     }
 
-    std::pair<std::string, std::string> parse_name_value(const std::string& line) {
-        if (line.empty() || line[0] == '#' || line[0] == '/')
-            return {};
-        auto parts = tea::split(line, '=');
-        if (parts.size() != 2)
-            return {};
-        std::string name = parts[0];
-        std::string value = parts[1];
-        if (name.find('-') != std::string::npos) {
-            name = name.substr(0, name.find('-'));
-        }
-        if (name.find(':') != std::string::npos) {
-            name = name.substr(0, name.find(':'));
-        }
-        return {name, value};
-    }
-    std::map<std::string, std::string> load_cmake_cache(const std::string& filepath) {
-        std::map<std::string, std::string> result;
-        if (!tea::path_exists(filepath))
-            return {};
-        std::string data = tea::file_get_contents(filepath);
-        for(auto line : tea::split(data, '\n')) {
-            auto pair = parse_name_value(line);
-            if (pair.first.empty())
-                continue;
-            result[pair.first] = pair.second;
+    subprocess::PipeOption Project::output_option() const {
+#ifndef _WIN32
+        // on a pipe compilers buffer their output and drop the colors
+        if (m_invocation_info.pty && isatty(STDOUT_FILENO))
+            return subprocess::PipeOption::pty;
+#endif
+        return subprocess::PipeOption::pipe;
+    }
+
+    CMakeProject::CMakeProject(std::string project_dir, std::string build_dir,
+            std::shared_ptr<CMakeCacheView> cache) : Project(project_dir, build_dir) {
+        m_cache = cache;
+    }
+
+    namespace {
+        bool is_multi_config_generator(std::string_view generator) {
+            return generator == "Ninja Multi-Config" || generator == "Xcode"
+                || generator.substr(0, 13) == "Visual Studio";
         }
-        return result;
+    }
+
+    bool CMakeProject::is_multi_config() {
+        return is_multi_config_generator(get_cmake_cache().get("CMAKE_GENERATOR"));
+    }
+
+    const CMakeCacheView& CMakeProject::get_cmake_cache() {
+        std::string path = tea::join_path(get_build_dir(), "CMakeCache.txt");
+        if (m_cache == nullptr || m_cache->path() != path) {
+            m_cache = std::make_shared<CMakeCacheView>(path);
+        } else {
+            m_cache->reload_if_changed();
+        }
+        return *m_cache;
     }
 
     bool CMakeProject::should_configure() {
-        std::string cmake_cache_file = tea::join_path(get_build_dir(), "CMakeCache.txt");
-        if (!tea::path_exists(cmake_cache_file))
+        auto& cache = get_cmake_cache();
+        if (cache.mtime() == 0)
             return true;
-        auto vars = load_cmake_cache(cmake_cache_file);
 
-        if (vars["CMAKE_GENERATOR"].empty())
+        if (cache.get("CMAKE_GENERATOR").empty())
             return true;
-        if (vars["CMAKE_HOME_DIRECTORY"].empty())
+        if (cache.get("CMAKE_HOME_DIRECTORY").empty())
             return true;
-        if (vars["CMAKE_PROJECT_NAME"].empty())
+        if (cache.get("CMAKE_PROJECT_NAME").empty())
             return true;
-        std::string cmake_file = tea::join_path(vars["CMAKE_HOME_DIRECTORY"], "CMakeLists.txt");
+        // there is no CMAKE_BUILD_TYPE, the build type needs to be one of
+        // the configurations instead
+        if (is_multi_config()) {
+            auto configs = tea::split(std::string(cache.get("CMAKE_CONFIGURATION_TYPES")), ';');
+            std::string config = cmake_build_type(get_invocation().build_type);
+            if (std::find(configs.begin(), configs.end(), config) == configs.end())
+                return true;
+        }
+        // toggling --time-trace needs the project include added or removed
+        bool has_time_trace = cache.get("CMAKE_PROJECT_INCLUDE") == time_trace_include_file();
+        if (has_time_trace != get_invocation().time_trace)
+            return true;
+        if (get_store() != nullptr && get_store()->is_open()
+            && !cmake_input_files(get_build_dir()).empty()) {
+            return inputs_changed();
+        }
+        std::string cmake_file = tea::join_path(std::string(cache.get("CMAKE_HOME_DIRECTORY")), "CMakeLists.txt");
         if (!tea::path_exists(cmake_file)) {
             return false;
         }
-        if (fs::last_write_time(cmake_file) > fs::last_write_time(cmake_cache_file))
+        if (fs::last_write_time(cmake_file) > fs::last_write_time(cache.path()))
             return true;
         return false;
     }
 
-    std::string cmake_build_type(BuildType build_type) {
-        switch (build_type) {
-        case BuildType::debug:      return "Debug";
-        case BuildType::release:    return "Release";
-        default:                    return "Release";
+    namespace {
+        const char* kFingerprintKey = "cmake_inputs";
+    }
+
+    bool CMakeProject::inputs_changed() {
+        FileFingerprints fingerprints;
+        std::string saved = get_store()->get(kFingerprintKey);
+        // never fingerprinted, this build dir was configured without us or
+        // the last configure failed
+        if (saved.empty())
+            return true;
+        fingerprints.load(saved);
+        uint64_t before = fingerprints.combined();
+        if (fingerprints.update(cmake_input_files(get_build_dir())) != before)
+            return true;
+        // touched but same content, remember the new mtimes and make the
+        // build tool agree by making cmake's outputs newer than its inputs
+        if (fingerprints.dirty()) {
+            get_store()->set(kFingerprintKey, fingerprints.serialize());
+            auto now = fs::file_time_type::clock::now();
+            for (auto& output : cmake_output_files(get_build_dir())) {
+                std::error_code ec;
+                fs::last_write_time(output, now, ec);
+            }
         }
+        return false;
     }
+
+    void CMakeProject::save_fingerprint() {
+        if (get_store() == nullptr || !get_store()->is_open())
+            return;
+        FileFingerprints fingerprints;
+        fingerprints.load(get_store()->get(kFingerprintKey));
+        fingerprints.update(cmake_input_files(get_build_dir()));
+        get_store()->set(kFingerprintKey, fingerprints.serialize());
+    }
+
+    void CMakeProject::clear_fingerprint() {
+        if (get_store() != nullptr && get_store()->is_open())
+            get_store()->set(kFingerprintKey, "");
+    }
+
+    void CMakeProject::configured(int status) {
+        // a failed configure may have left the build dir half generated
+        if (status == 0)
+            save_fingerprint();
+    }
+
     InputStream_uptr CMakeProject::configure(CommandLine commandExtra) {
+        // saved again once configure succeeded
+        clear_fingerprint();
         if (!fs::exists(get_build_dir())) {
             tea::mkdir_p(get_build_dir());
         }
@@ -173,45 +375,242 @@ namespace buildhl {
         CommandLine command = {"cmake", get_project_dir()};
 
         bool generator_specified = false;
+        bool multi_config = false;
         bool build_type_specified = false;
+        // the users own include, chained from ours for --time-trace
+        std::string user_include(get_cmake_cache().get("BUILDHL_PROJECT_INCLUDE"));
+        std::string_view cached_include = get_cmake_cache().get("CMAKE_PROJECT_INCLUDE");
+        if (!cached_include.empty() && cached_include != time_trace_include_file())
+            user_include = cached_include;
         for(auto& arg : commandExtra) {
             if (arg[0] == '-' && arg[1] == 'G')
                 generator_specified = true;
+            if (arg.find("Multi-Config") != std::string::npos)
+                multi_config = true;
             if (tea::starts_with(arg, "-DCMAKE_BUILD_TYPE="))
                 build_type_specified = true;
+            bool project_include = tea::starts_with(arg, "-DCMAKE_PROJECT_INCLUDE=")
+                || tea::starts_with(arg, "-DCMAKE_PROJECT_INCLUDE:");
+            if (project_include && arg.find('=') != std::string::npos)
+                user_include = arg.substr(arg.find('=') + 1);
         }
         command.insert(command.end(), commandExtra.begin(), commandExtra.end());
 
-        std::string cmake_cache_file = tea::join_path(get_build_dir(), "CMakeCache.txt");
-        auto vars = load_cmake_cache(cmake_cache_file);
-        generator_specified |= !vars["CMAKE_GENERATOR"].empty();
+        auto& cache = get_cmake_cache();
+        multi_config |= is_multi_config();
+        generator_specified |= !cache.get("CMAKE_GENERATOR").empty();
 
-        if (!generator_specified && has_ninja)
-            command.push_back("-GNinja");
+        if (!generator_specified && has_ninja) {
+            // one build dir for all build types, switching doesn't configure
+            multi_config = get_invocation().multi_config;
+            command.push_back(multi_config? "-GNinja Multi-Config" : "-GNinja");
+        }
+
+        if (get_invocation().time_trace) {
+            tea::mkdir_p(tea::dirname(time_trace_include_file()));
+            tea::file_put_contents(time_trace_include_file(), time_trace_cmake_include());
+            // after the users -D so ours is the one set
+            command.push_back("-DCMAKE_PROJECT_INCLUDE=" + time_trace_include_file());
+            command.push_back("-DBUILDHL_PROJECT_INCLUDE=" + user_include);
+        } else if (cache.get("CMAKE_PROJECT_INCLUDE") == time_trace_include_file()) {
+            if (user_include.empty())
+                command.push_back("-UCMAKE_PROJECT_INCLUDE");
+            else
+                command.push_back("-DCMAKE_PROJECT_INCLUDE=" + user_include);
+            command.push_back("-UBUILDHL_PROJECT_INCLUDE");
+        }
 
         std::string build_type = cmake_build_type(get_invocation().build_type);
-        if (!build_type_specified)
+        if (multi_config) {
+            std::string configs(cache.get("CMAKE_CONFIGURATION_TYPES"));
+            auto list = tea::split(configs, ';');
+            if (!configs.empty() && std::find(list.begin(), list.end(), build_type) == list.end())
+                command.push_back("-DCMAKE_CONFIGURATION_TYPES=" + configs + ";" + build_type);
+        } else if (!build_type_specified) {
             command.push_back("-DCMAKE_BUILD_TYPE=" + build_type);
+        }
+
+        if (get_invocation().fast_linker) {
+            // only when cmake initializes the linker flags, not to overwrite
+            // what the user set since
+            bool specified = cache.find("CMAKE_LINKER_TYPE") != nullptr
+                || cache.find("CMAKE_EXE_LINKER_FLAGS") != nullptr
+                || subprocess::cenv["LDFLAGS"].to_string().find("-fuse-ld") != std::string::npos;
+            for (auto& arg : commandExtra)
+                specified |= arg.find("LINKER") != std::string::npos;
+            std::string compiler = subprocess::cenv["CXX"];
+            if (compiler.empty())
+                compiler = subprocess::find_program("c++");
+            if (!specified && !compiler.empty()) {
+                std::string linker = find_fast_linker(get_store(), compiler,
+                    tea::join_path(get_build_dir(), "buildhl/linker_probe"));
+                for (auto& arg : fast_linker_arguments(linker))
+                    command.push_back(arg);
+            }
+        }
+
+        if (get_invocation().compiler_cache) {
+            std::string launcher;
+            for (const char* lang : {"C", "CXX"}) {
+                std::string name = std::string("CMAKE_") + lang + "_COMPILER_LAUNCHER";
+                // an empty launcher in the cache is the user opting out
+                bool specified = cache.find(name) != nullptr
+                    || !subprocess::cenv[name].to_string().empty();
+                for (auto& arg : commandExtra)
+                    specified |= tea::starts_with(arg, ("-D" + name).c_str());
+                if (specified)
+                    continue;
+                if (launcher.empty())
+                    launcher = find_compiler_cache();
+                if (launcher.empty())
+                    break;
+                command.push_back("-D" + name + "=" + launcher);
+            }
+        }
+
+        return popen_command(command, get_build_dir(), {}, output_option());
+    }
 
-        return popen_command(command, get_build_dir());
+    InputStream_uptr CMakeProject::run_tests() {
+        if (get_store() != nullptr)
+            TestHistory(*get_store()).write_cost_data(get_build_dir());
+        CommandLine command = {"ctest", "--output-on-failure"};
+        if (get_invocation().max_jobs > 0)
+            command.push_back("-j" + std::to_string(get_invocation().max_jobs));
+        if (is_multi_config()) {
+            command.push_back("-C");
+            command.push_back(cmake_build_type(get_invocation().build_type));
+        }
+        m_tests = std::make_shared<CTestOutputParser>();
+        return std::make_unique<CTestInputStream>(popen_process(command, get_build_dir()), m_tests);
     }
 
     InputStream_uptr CMakeProject::make(std::string target) {
         subprocess::EnvGuard env_guard;
-        CommandLine command = {"cmake", "--build", get_build_dir()};
-        if (!target.empty()) {
-            command.push_back("--target");
-            command.push_back(target);
+        if (target == "test" && get_invocation().ctest)
+            return run_tests();
+        auto& cache = get_cmake_cache();
+        std::string_view generator = cache.get("CMAKE_GENERATOR");
+        bool is_ninja = generator.find("Ninja") != std::string_view::npos;
+        // respect the users own format, they just don't get running jobs.
+        if (is_ninja && subprocess::cenv["NINJA_STATUS"].to_string().empty()) {
+            subprocess::cenv["NINJA_STATUS"] = kNinjaStatusFormat;
+        }
+        // running the build tool directly saves starting cmake, regenerating
+        // still works through the rerun rule cmake generated for it
+        std::string make_program(cache.get("CMAKE_MAKE_PROGRAM"));
+        bool multi_config = is_multi_config();
+        std::string config = cmake_build_type(get_invocation().build_type);
+        bool direct = get_invocation().direct_build
+            && (generator == "Ninja" || generator == "Unix Makefiles" || generator == "Ninja Multi-Config")
+            && tea::is_file(make_program);
+        CommandLine command;
+        if (direct) {
+            command = {make_program, "-C", get_build_dir()};
+            if (multi_config) {
+                command.push_back("-f");
+                command.push_back("build-" + config + ".ninja");
+            }
+            if (!target.empty())
+                command.push_back(target);
+        } else {
+            command = {"cmake", "--build", get_build_dir()};
+            if (multi_config) {
+                command.push_back("--config");
+                command.push_back(config);
+            }
+            if (!target.empty()) {
+                command.push_back("--target");
+                command.push_back(target);
+            }
+        }
+        m_ninja_log_offset = -1;
+        if (is_ninja) {
+            std::error_code ec;
+            auto size = fs::file_size(tea::join_path(get_build_dir(), ".ninja_log"), ec);
+            m_ninja_log_offset = ec? 0 : size;
+        }
+        m_compiler_cache.clear();
+        for (const char* name : {"CMAKE_CXX_COMPILER_LAUNCHER", "CMAKE_C_COMPILER_LAUNCHER"}) {
+            std::string launcher(cache.get(name));
+            if (is_compiler_cache(launcher)
+                    && read_compiler_cache_stats(launcher, m_compiler_cache_before)) {
+                m_compiler_cache = launcher;
+                break;
+            }
+        }
+        if (get_invocation().jobserver && get_job_server() == nullptr && JobServer::supported()) {
+            int jobs = get_invocation().max_jobs > 0? get_invocation().max_jobs : cpu_count();
+            std::string fifo = tea::join_path(get_build_dir(), "buildhl/jobserver.fifo");
+            tea::mkdir_p(tea::dirname(fifo));
+            auto job_server = std::make_shared<JobServer>(jobs, get_invocation().job_memory);
+            if (job_server->start(fifo)) {
+                set_job_server(job_server);
+                m_own_job_server = true;
+            }
+        }
+        if (get_job_server() != nullptr) {
+            // make and ninja join it as long as they don't get their own -j
+            std::string makeflags = subprocess::cenv["MAKEFLAGS"];
+            subprocess::cenv["MAKEFLAGS"] = makeflags + (makeflags.empty()? "" : " ")
+                + get_job_server()->makeflags(is_ninja);
+            // make before 4.4 only knows the pipe protocol
+            JobServer::InheritClient inherit(is_ninja? nullptr : get_job_server().get());
+            return popen_command(command, "", {}, output_option());
         }
         if (get_invocation().max_jobs > 0) {
-            command.push_back("--");
+            if (!direct)
+                command.push_back("--");
             command.push_back("-j" + std::to_string(get_invocation().max_jobs));
         }
 
-        return popen_command(command);
+        return popen_command(command, "", {}, output_option());
     }
 
 
+    std::vector<std::string> CMakeProject::build_report(const std::vector<InvocationUsage>& usages) {
+        std::vector<std::string> lines;
+        if (m_tests != nullptr) {
+            if (get_store() != nullptr)
+                TestHistory(*get_store()).record(m_tests->records());
+            return test_report(m_tests->records());
+        }
+        CompilerCacheStats after;
+        if (!m_compiler_cache.empty() && get_store() != nullptr
+                && read_compiler_cache_stats(m_compiler_cache, after)) {
+            std::string line = compiler_cache_report(*get_store(), m_compiler_cache_before, after, usages);
+            if (!line.empty())
+                lines.push_back(line);
+        }
+        if (m_own_job_server) {
+            auto job_server = get_job_server();
+            job_server->stop();
+            if (!job_server->summary().empty())
+                lines.push_back(job_server->summary());
+        }
+        auto& cache = get_cmake_cache();
+        std::string linker(cache.get("CMAKE_LINKER_TYPE"));
+        std::string_view flags = cache.get("CMAKE_EXE_LINKER_FLAGS");
+        if (linker.empty() && flags.find("-fuse-ld=") != std::string_view::npos) {
+            flags.remove_prefix(flags.find("-fuse-ld=") + strlen("-fuse-ld="));
+            linker = std::string(flags.substr(0, flags.find(' ')));
+        }
+        auto steps = m_ninja_log_offset >= 0? ninja_link_steps(get_build_dir(), m_ninja_log_offset)
+            : monitored_link_steps(usages);
+        for (auto& line : link_report(steps, tea::to_lower(linker)))
+            lines.push_back(line);
+        if (get_invocation().time_trace) {
+            auto traces = find_time_traces(get_build_dir());
+            for (auto& line : aggregate_time_traces(traces).to_lines())
+                lines.push_back(line);
+        }
+        return lines;
+    }
+
+    std::string CMakeProject::time_trace_include_file() const {
+        return tea::join_path(get_build_dir(), "buildhl/time_trace.cmake");
+    }
+
 
     std::string join(const std::vector<std::string>& vec, char delimiter) {
         bool put_del = false;
@@ -226,45 +625,49 @@ namespace buildhl {
         return result;
     }
 
+    namespace {
+        /** whether configure would give the build dir a multi config
+            generator, the generator it has already or the one configure
+            picks. With a single config one it would be stuck with one
+            build type.
+        */
+        bool multi_config_generator_used(const InvocationInfo& invocation, const std::string& build_dir) {
+            CMakeCacheView cache(tea::join_path(build_dir, "CMakeCache.txt"));
+            if (!cache.get("CMAKE_GENERATOR").empty())
+                return is_multi_config_generator(cache.get("CMAKE_GENERATOR"));
+            auto& options = invocation.configure_options;
+            for (size_t i = 0; i < options.size(); ++i) {
+                if (options[i] == "-G")
+                    return i + 1 < options.size() && is_multi_config_generator(options[i+1]);
+                if (tea::starts_with(options[i], "-G"))
+                    return is_multi_config_generator(options[i].substr(2));
+            }
+            return !subprocess::find_program("ninja").empty();
+        }
+    }
+
+    std::string default_build_dir(const InvocationInfo& invocation, const std::string& project_dir) {
+        if (!invocation.build_dir.empty())
+            return invocation.build_dir;
+        std::string multi_dir = join({project_dir, "build", "multi"}, '/');
+        if (invocation.multi_config && multi_config_generator_used(invocation, multi_dir))
+            return multi_dir;
+        return join({project_dir, "build",
+            invocation.build_type == BuildType::release? "release" : "debug"}, '/');
+    }
+
     CMakeProject_uptr detect_cmake_project(InvocationInfo invocation) {
         std::string dir = subprocess::abspath(invocation.project_dir);
         std::string project_dir;
         std::string build_dir;
-        using tea::split;
-        if (fs::exists(dir + "/CMakeCache.txt")) {
-            FILE*fp = fopen((dir + "/CMakeCache.txt").c_str(), "rb");
-            CFileInputStream input(fp);
-            std::string data = read_all(input);
-
-            auto lines = split(data, '\n');
-            for(auto& line : lines) {
-                if (line.empty() || line[0] == '#' || line[0] == '/')
-                    continue;
-                auto parts = split(line, '=');
-                if (parts.size() != 2)
-                    continue;
-                std::string name = parts[0];
-                std::string value = parts[1];
-                if (name.find('-') != std::string::npos) {
-                    name = name.substr(0, name.find('-'));
-                }
-                if (name.find(':') != std::string::npos) {
-                    name = name.substr(0, name.find(':'));
-                }
-                if (name == "CMAKE_HOME_DIRECTORY") {
-                    project_dir = value;
-                }
-            }
+        auto cache = std::make_shared<CMakeCacheView>(tea::join_path(dir, "CMakeCache.txt"));
+        if (cache->mtime() != 0) {
+            project_dir = cache->get("CMAKE_HOME_DIRECTORY");
             build_dir = dir;
-            return std::make_unique<CMakeProject>(project_dir, build_dir);
+            return std::make_unique<CMakeProject>(project_dir, build_dir, cache);
         } else if (fs::exists("CMakeLists.txt")) {
             project_dir = dir;
-            build_dir = invocation.build_dir;
-            if (build_dir.empty()) {
-                build_dir = join({project_dir, "build",
-                    invocation.build_type == BuildType::release? "release" : "debug"}, '/');
-            }
-
+            build_dir = default_build_dir(invocation, project_dir);
             return std::make_unique<CMakeProject>(project_dir, build_dir);
         }
 
@@ -282,7 +685,8 @@ namespace buildhl {
         return cmd;
     }
 
-    BuildProject::BuildProject(const std::string& project_dir) : Project(project_dir) {
+    BuildProject::BuildProject(const std::string& project_dir, const std::string& build_dir)
+            : Project(project_dir, build_dir) {
         m_build_file = project_dir + "/buildhl.json";
         auto json = tea::load_json_file(m_build_file);
 
@@ -308,14 +712,12 @@ namespace buildhl {
         return args;
     }
 
-    void load_env(CommandLine cmd) {
-        if (cmd.empty())
-            return;
+    typedef std::vector<std::pair<std::string, std::string>> EnvVars;
 
-        auto env = subprocess::current_env_copy();
-        for (auto& part : cmd) {
-            part = tea::replace_string_variables(part, env);
-        }
+    /** runs cmd and parses the NAME=VALUE lines it prints
+        @param success  set to whether the script exited with 0
+    */
+    EnvVars run_env_script(CommandLine cmd, bool* success=nullptr) {
         #ifdef _WIN32
         cmd = process_shebang_recursively(cmd);
         cmd = tea::process_env(cmd);
@@ -324,11 +726,14 @@ namespace buildhl {
         auto process = subprocess::RunBuilder(cmd)
             .cout(subprocess::PipeOption::pipe)
             .run();
+        if (success != nullptr)
+            *success = (bool)process;
         auto lines = tea::split_no_empty(process.cout, '\n');
 
         using namespace lex;
         std::vector<StaticString> ignore_env {"CWD", "PWD", "HOME",
             "HOMEDRIVE", "HOMEPATH", "USER", "UserProfile"};
+        EnvVars result;
         for (auto& line : lines) {
             StaticString str(line.c_str());
             if (str.find("=") == StaticString::npos)
@@ -360,15 +765,83 @@ namespace buildhl {
             }
             if (ignore)
                 continue;
-            subprocess::cenv[name.to_string()] = value.to_string();
+            result.push_back({name.to_string(), value.to_string()});
+        }
+        return result;
+    }
+
+    /*  The script's output is assumed to depend on its command line, with
+        variables already substituted, PATH and the files it references
+        on the command line. Whatever else it reads needs --refresh-env.
+    */
+    std::string env_script_cache_key(const CommandLine& cmd) {
+        uint64_t hash = 0;
+        auto add = [&hash](const std::string& str) {
+            hash = hash64(str.data(), str.size() + 1, hash);
+        };
+        for (auto& part : cmd) {
+            add(part);
+            std::string path = part;
+            if (&part == &cmd[0] && !tea::is_file(path))
+                path = subprocess::find_program(part);
+            if (path.empty() || !tea::is_file(path))
+                continue;
+            std::error_code ec;
+            auto mtime = fs::last_write_time(path, ec).time_since_epoch().count();
+            hash = hash64(&mtime, sizeof(mtime), hash);
+            MappedFile file(path);
+            uint64_t content = hash64(file.data(), file.size());
+            hash = hash64(&content, sizeof(content), hash);
+        }
+        add(subprocess::cenv["PATH"]);
+        char hex[17];
+        snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+        return std::string("env_script:") + hex;
+    }
+
+    EnvVars BuildProject::env_script_result() {
+        auto env = subprocess::current_env_copy();
+        CommandLine cmd = m_commands.env_script;
+        for (auto& part : cmd) {
+            part = tea::replace_string_variables(part, env);
         }
+        BuildStore* store = get_store();
+        if (store == nullptr || !store->is_open())
+            return run_env_script(cmd);
+
+        std::string key = env_script_cache_key(cmd);
+        if (!get_invocation().refresh_env) {
+            std::string cached = store->get(key);
+            auto json = nlohmann::json::parse(cached, nullptr, false);
+            if (json.is_array()) {
+                EnvVars result;
+                for (auto& pair : json) {
+                    if (pair.is_array() && pair.size() == 2 && pair[0].is_string() && pair[1].is_string())
+                        result.push_back({pair[0].get<std::string>(), pair[1].get<std::string>()});
+                }
+                return result;
+            }
+        }
+        bool success = false;
+        EnvVars result = run_env_script(cmd, &success);
+        if (success)
+            store->set(key, nlohmann::json(result).dump());
+        return result;
     }
 
     void BuildProject::load_env_if_needed() {
         if (m_env_loaded)
             return;
-        load_env(m_commands.env_script);
+        if (!m_commands.env_script.empty()) {
+            for (auto& pair : env_script_result())
+                subprocess::cenv[pair.first] = pair.second;
+        }
         m_base_project = detect_cmake_project(get_invocation());
+        if (m_base_project != nullptr) {
+            m_base_project->set_invocation(get_invocation());
+            m_base_project->set_store(get_store());
+            m_base_project->set_job_server(get_job_server());
+        }
         m_env_loaded = true;
     }
 
@@ -382,7 +855,7 @@ namespace buildhl {
             auto env = get_build_env();
             CommandLine cmd = m_commands.configure;
             for (auto& part : cmd) {
-                part = tea::replace_string_variables(part, env);
+                part = tea::replace_string_variables(part, env_lookup(env));
             }
             auto process = subprocess::RunBuilder(cmd).env(env).run();
             return !process;
@@ -391,11 +864,9 @@ namespace buildhl {
         return m_base_project == nullptr && !m_commands.configure.empty();
     }
 
-    subprocess::EnvMap BuildProject::get_build_env() {
+    subprocess::EnvSnapshot BuildProject::get_build_env() {
         load_env_if_needed();
-        using std::to_string;
-        auto env = subprocess::current_env_copy();
-        return env;
+        return subprocess::EnvSnapshot::current();
     }
 
     InputStream_uptr BuildProject::configure(CommandLine args) {
@@ -409,10 +880,15 @@ namespace buildhl {
         auto env = get_build_env();
 
         for (auto& part : cmd) {
-            part = tea::replace_string_variables(part, env);
+            part = tea::replace_string_variables(part, env_lookup(env));
         }
         cmd.insert(cmd.end(), args.begin(), args.end());
-        return popen_command(cmd, "", env);
+        return popen_command(cmd, "", env, output_option());
+    }
+
+    void BuildProject::configured(int status) {
+        if (m_commands.configure.empty() && m_base_project != nullptr)
+            m_base_project->configured(status);
     }
 
     InputStream_uptr BuildProject::make(std::string target) {
@@ -423,22 +899,27 @@ namespace buildhl {
             }
             return nullptr;
         }
-        auto env = subprocess::current_env_copy();
+        auto env = subprocess::EnvSnapshot::current();
         if (!target.empty())
-            env["TARGET"] = target;
+            env.set("TARGET", target);
 
         for (auto& part : cmd) {
-            part = tea::replace_string_variables(part, env);
+            part = tea::replace_string_variables(part, env_lookup(env));
         }
-        return popen_command(cmd, "", env);
+        return popen_command(cmd, "", env, output_option());
+    }
+
+    std::vector<std::string> BuildProject::build_report(const std::vector<InvocationUsage>& usages) {
+        if (m_base_project != nullptr)
+            return m_base_project->build_report(usages);
+        return {};
     }
 
     BuildProject_uptr detect_build_project(InvocationInfo invocation) {
         std::string dir = subprocess::abspath(invocation.project_dir);
         std::string project_dir = invocation.project_dir;
-        using tea::split;
         if (fs::exists(dir + "/buildhl.json")) {
-            return std::make_unique<BuildProject>(project_dir);
+            return std::make_unique<BuildProject>(project_dir, default_build_dir(invocation, dir));
         }
 
         return nullptr;
@@ -7,7 +7,15 @@
 #include <map>
 #include <subprocess.hpp>
 
+#include "CMakeCacheView.hpp"
+#include "JobServer.hpp"
+#include "ResourceMonitor.hpp"
+#include "compiler_cache.hpp"
+#include "test_runner.hpp"
+
 namespace buildhl {
+    class BuildStore;
+
     using std::unique_ptr;
     typedef intptr_t ssize_t;
     typedef std::vector<std::string> CommandLine;
@@ -26,11 +34,48 @@ namespace buildhl {
         /** base path where all paths to be printed relative to */
         std::string                 path_base;
         std::vector<std::string>    configure_options;
+        /** build every build type and target given at once */
+        bool                        concurrent = false;
+        /** all build types given, build_type is the last of them */
+        std::vector<BuildType>      build_types;
+        /** all targets given, target is the last of them */
+        std::vector<std::string>    targets;
         int                         max_jobs = 0;
+        /** add -ftime-trace for clang and report hot spots after the build */
+        bool                        time_trace = false;
+        /** don't build, report headers by how much they cost to rebuild */
+        bool                        analyze_includes = false;
+        /** run the env_script of buildhl.json even if its result is cached */
+        bool                        refresh_env = false;
+        /** seconds between samples of the build's memory, 0 disables */
+        double                      monitor_interval = 0.5;
+        /** add ccache or sccache as compiler launcher if the user hasn't */
+        bool                        compiler_cache = true;
+        /** configure build/multi with Ninja Multi-Config for all build types */
+        bool                        multi_config = false;
+        /** run ctest with -j for the test target instead of building it */
+        bool                        ctest = true;
+        /** link with mold or lld if the compiler can */
+        bool                        fast_linker = false;
+        /** run ninja or make directly instead of through cmake --build */
+        bool                        direct_build = true;
+        /** run a memory aware jobserver for the build */
+        bool                        jobserver = false;
+        /** memory a job needs, 0 to use the one learned from previous builds */
+        int64_t                     job_memory = 0;
+        /** run the build on a pseudo terminal when our output is a terminal */
+        bool                        pty = false;
+        /** drop the colors of the build tools instead of keeping them */
+        bool                        strip_input_colors = false;
     };
 
     InvocationInfo parse_args(std::vector<std::string> args);
 
+    /** One invocation per combination of the build types and targets of
+        a concurrent invocation, in the order they were given.
+    */
+    std::vector<InvocationInfo> concurrent_invocations(const InvocationInfo& invocation);
+
     struct VBase {
         virtual ~VBase(){}
     };
@@ -86,6 +131,10 @@ namespace buildhl {
         ssize_t read(void* buffer, size_t size) override {
             return subprocess::pipe_read(mHandle, buffer, size);
         }
+    protected:
+        subprocess::PipeHandle handle() const { return mHandle; }
+        /** someone else closes the handle */
+        void release() { mHandle = subprocess::kBadPipeValue; }
     private:
         subprocess::PipeHandle mHandle  = subprocess::kBadPipeValue;
     };
@@ -94,6 +143,22 @@ namespace buildhl {
         PopenInputStream(subprocess::Popen&& popen) :
             PipeInputStream(popen.cout), mPopen(std::move(popen)) {
         }
+        // mPopen closes cout before it waits for the process
+        ~PopenInputStream() { release(); }
+
+        enum class Ready {
+            /** there is output to read, or the pipe was closed */
+            output,
+            /** the process exited without leaving output. Something it
+                started may still hold the pipe open, don't read.
+            */
+            exited,
+            timeout
+        };
+        /** Waits for output, the exit of the process or for timeout seconds
+            in one poll.
+        */
+        Ready wait(double timeout);
 
         subprocess::Popen& popen() { return mPopen; }
     private:
@@ -102,19 +167,6 @@ namespace buildhl {
     typedef std::unique_ptr<PopenInputStream> PopenInputStream_uptr;
 
 
-    inline std::string getline(InputStream& stream) {
-        std::string result;
-        while (true) {
-            char ch;
-            ssize_t transfered = stream.read(&ch, 1);
-            if (transfered != 1)
-                break;
-            result += ch;
-            if (ch == '\n')
-                break;
-        }
-        return result;
-    }
     class Project : public VBase {
     public:
         Project(std::string project_dir, std::string build_dir="");
@@ -123,45 +175,100 @@ namespace buildhl {
 
         InvocationInfo get_invocation() const { return m_invocation_info; }
         void set_invocation(const InvocationInfo& info) { m_invocation_info = info;}
+        /** buildhl's data about the build dir, may be null */
+        BuildStore* get_store() const { return m_store; }
+        void set_store(BuildStore* store) { m_store = store; }
+        /** jobserver shared with the builds running at once, may be null */
+        std::shared_ptr<JobServer> get_job_server() const { return m_job_server; }
+        void set_job_server(std::shared_ptr<JobServer> job_server) { m_job_server = job_server; }
 
         virtual bool should_configure() {return false;}
         virtual InputStream_uptr configure(CommandLine command){return nullptr;}
+        /** Called with the exit status of what configure() started once it
+            finished, make() isn't called if it failed.
+        */
+        virtual void configured(int status) {}
         virtual InputStream_uptr make(std::string target="")=0;
+        /** Called once the build has finished.
+
+            @param usages   resources of the tools the build ran, empty if
+                            they weren't monitored.
+            @return lines to print in the summary at the end of the build.
+        */
+        virtual std::vector<std::string> build_report(const std::vector<InvocationUsage>& usages) { return {}; }
+    protected:
+        /** where the output of configure and make goes, pty or pipe */
+        subprocess::PipeOption output_option() const;
     private:
         std::string mProjectDir;
         std::string mBuildDir;
         InvocationInfo m_invocation_info;
+        BuildStore* m_store = nullptr;
+        std::shared_ptr<JobServer> m_job_server;
     };
     typedef std::unique_ptr<Project> Project_uptr;
 
     class CMakeProject : public Project {
     public:
-        CMakeProject(std::string project_dir, std::string build_dir) : Project(project_dir, build_dir) {}
+        CMakeProject(std::string project_dir, std::string build_dir,
+            std::shared_ptr<CMakeCacheView> cache=nullptr);
 
         bool should_configure() override;
         InputStream_uptr configure(CommandLine command) override;
+        void configured(int status) override;
         InputStream_uptr make(std::string target="") override;
+        std::vector<std::string> build_report(const std::vector<InvocationUsage>& usages) override;
 
+        /** CMakeCache.txt of the build dir, reloaded when it changed */
+        const CMakeCacheView& get_cmake_cache();
+        /** the generator builds all build types from one build dir */
+        bool is_multi_config();
     private:
+        /** ctest ordered by the test history, the results go to m_tests */
+        InputStream_uptr run_tests();
+        std::string time_trace_include_file() const;
+        /** @return whether the contents of cmake's input files changed */
+        bool inputs_changed();
+        void save_fingerprint();
+        /** until configure succeeds its inputs count as changed */
+        void clear_fingerprint();
         std::map<std::string, std::string> mDefines;
+        std::shared_ptr<CMakeCacheView> m_cache;
+        /** make started the jobserver, it isn't shared */
+        bool m_own_job_server = false;
+        /** launcher the stats were snapshotted from before the build */
+        std::string m_compiler_cache;
+        CompilerCacheStats m_compiler_cache_before;
+        std::shared_ptr<CTestOutputParser> m_tests;
+        /** size of .ninja_log before the build, -1 if not a ninja build */
+        int64_t m_ninja_log_offset = -1;
     };
     typedef std::unique_ptr<CMakeProject> CMakeProject_uptr;
 
 
+    /** build/<build type> of the project dir, or build/multi for
+        --multi-config if the build dir will have a multi config generator
+    */
+    std::string default_build_dir(const InvocationInfo& invocation, const std::string& project_dir);
     CMakeProject_uptr detect_cmake_project(InvocationInfo invocation);
 
 
     class BuildProject : public Project {
     public:
-        BuildProject(const std::string& build_file);
+        BuildProject(const std::string& project_dir, const std::string& build_dir);
 
         void load_env_if_needed();
         bool should_configure() override;
         InputStream_uptr configure(CommandLine command) override;
+        void configured(int status) override;
         InputStream_uptr make(std::string target="") override;
+        std::vector<std::string> build_report(const std::vector<InvocationUsage>& usages) override;
 
-        std::map<std::string, std::string> get_build_env();
+        subprocess::EnvSnapshot get_build_env();
     private:
+        /** @return the variables env_script sets, cached in the store */
+        std::vector<std::pair<std::string, std::string>> env_script_result();
+
         std::string m_build_file;
 
         struct {
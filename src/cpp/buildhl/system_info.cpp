@@ -0,0 +1,156 @@
+#include "system_info.hpp"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include <teaport_utils/fileutils.hpp>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace buildhl {
+    namespace {
+        /** reads a file in /proc or /sys, these report a size of 0 */
+        std::string read_proc_file(const std::string& path) {
+            FILE* fp = fopen(path.c_str(), "r");
+            if (fp == nullptr)
+                return {};
+            std::string result;
+            char buffer[4096];
+            size_t size;
+            while ((size = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+                result.append(buffer, size);
+            fclose(fp);
+            return result;
+        }
+
+        /** directory of our cgroup for controller, "" for v2, empty if none */
+        std::string cgroup_dir(const std::string& controller) {
+            std::string data = read_proc_file("/proc/self/cgroup");
+            // lines look like "4:cpu,cpuacct:/path", v2 has "0::/path"
+            size_t pos = 0;
+            while (pos < data.size()) {
+                size_t end = data.find('\n', pos);
+                if (end == std::string::npos)
+                    end = data.size();
+                std::string line = data.substr(pos, end - pos);
+                pos = end + 1;
+                size_t first = line.find(':');
+                size_t second = line.find(':', first + 1);
+                if (first == std::string::npos || second == std::string::npos)
+                    continue;
+                std::string controllers = line.substr(first + 1, second - first - 1);
+                if (("," + controllers + ",").find("," + controller + ",") == std::string::npos)
+                    continue;
+                std::string path = line.substr(second + 1);
+                std::string root = "/sys/fs/cgroup";
+                if (!controller.empty()) {
+                    root += "/" + controllers;
+                    if (!tea::path_exists(root))
+                        root = "/sys/fs/cgroup/" + controller;
+                }
+                std::string dir = root + (path == "/"? std::string() : path);
+                // in a container the path is the hosts but our cgroup is mounted as root
+                if (!tea::path_exists(dir))
+                    return root;
+                return dir;
+            }
+            return {};
+        }
+
+        int64_t read_cgroup_value(const std::string& dir, const char* name) {
+            if (dir.empty())
+                return -1;
+            std::string data = read_proc_file(dir + "/" + name);
+            if (data.empty() || data.compare(0, 3, "max") == 0)
+                return -1;
+            return std::strtoll(data.c_str(), nullptr, 10);
+        }
+    }
+
+    int cpu_count() {
+#ifdef __linux__
+        cpu_set_t set;
+        if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0)
+            return CPU_COUNT(&set);
+#endif
+        int count = std::thread::hardware_concurrency();
+        return count > 0? count : 1;
+    }
+
+    double cpu_quota() {
+        // v2 "quota period" or "max period"
+        std::string data = read_proc_file(cgroup_dir("") + "/cpu.max");
+        if (!data.empty() && data.compare(0, 3, "max") != 0) {
+            char* end;
+            double quota = std::strtod(data.c_str(), &end);
+            double period = std::strtod(end, nullptr);
+            if (quota > 0 && period > 0)
+                return quota/period;
+        }
+        std::string dir = cgroup_dir("cpu");
+        int64_t quota   = read_cgroup_value(dir, "cpu.cfs_quota_us");
+        int64_t period  = read_cgroup_value(dir, "cpu.cfs_period_us");
+        if (quota > 0 && period > 0)
+            return (double)quota/period;
+        return -1;
+    }
+
+    double load_average() {
+#ifdef _WIN32
+        return -1;
+#else
+        double load;
+        if (getloadavg(&load, 1) != 1)
+            return -1;
+        return load;
+#endif
+    }
+
+    int64_t available_memory() {
+        std::string dir = cgroup_dir("");
+        int64_t max     = read_cgroup_value(dir, "memory.max");
+        int64_t current = read_cgroup_value(dir, "memory.current");
+        if (max < 0 || current < 0) {
+            // v1 reports a huge number instead of max when unlimited
+            dir     = cgroup_dir("memory");
+            max     = read_cgroup_value(dir, "memory.limit_in_bytes");
+            current = read_cgroup_value(dir, "memory.usage_in_bytes");
+        }
+        return available_memory(read_proc_file("/proc/meminfo"), max, current);
+    }
+
+    int64_t available_memory(const std::string& meminfo, int64_t cgroup_max, int64_t cgroup_current) {
+        int64_t available = -1;
+        size_t pos = meminfo.find("MemAvailable:");
+        if (pos != std::string::npos) {
+            // value is in kB
+            available = std::strtoll(meminfo.c_str() + pos + strlen("MemAvailable:"), nullptr, 10)*1024;
+        }
+        if (cgroup_max >= 0 && cgroup_current >= 0) {
+            int64_t left = cgroup_max > cgroup_current? cgroup_max - cgroup_current : 0;
+            if (available < 0 || left < available)
+                available = left;
+        }
+        return available;
+    }
+
+    int64_t parse_bytes(const std::string& str) {
+        char* end = nullptr;
+        double value = std::strtod(str.c_str(), &end);
+        if (end == str.c_str() || value < 0)
+            return -1;
+        switch (std::toupper(*end)) {
+        case 'K': value *= 1024; break;
+        case 'M': value *= 1024*1024; break;
+        case 'G': value *= 1024.0*1024*1024; break;
+        case 'T': value *= 1024.0*1024*1024*1024; break;
+        case 0: break;
+        default: return -1;
+        }
+        return value;
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace buildhl {
+    /** Number of CPUs this process may run on, respects cpusets. */
+    int cpu_count();
+
+    /** CPUs worth of time our cgroup may use, cpu.max or cfs quota.
+        -1 if there is no quota.
+    */
+    double cpu_quota();
+
+    /** 1 minute load average, -1 if unknown. */
+    double load_average();
+
+    /** Bytes of memory that can still be used without swapping.
+
+        The smaller of MemAvailable from /proc/meminfo and what is left
+        below memory.max of our cgroup. -1 if unknown.
+    */
+    int64_t available_memory();
+    /** available_memory() of the contents of /proc/meminfo and memory.max
+        and memory.current of the cgroup, -1 for the ones unknown.
+    */
+    int64_t available_memory(const std::string& meminfo, int64_t cgroup_max, int64_t cgroup_current);
+
+    /** Parses sizes like 512M, 2G or 1048576 into bytes, -1 on error. */
+    int64_t parse_bytes(const std::string& str);
+}
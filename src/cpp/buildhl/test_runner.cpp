@@ -0,0 +1,189 @@
+#include "test_runner.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <regex>
+#include <set>
+#include <sstream>
+
+#include <teaport_utils/fileutils.hpp>
+
+#include "BuildStore.hpp"
+#include "highlight.hpp"
+
+namespace buildhl {
+    namespace {
+        /** failures listed in the report, the rest are in the output */
+        const size_t kReportedFailures  = 10;
+        const size_t kReportedSlowest   = 3;
+        /** runs the average is taken over, older ones fade out */
+        const int kAverageRuns = 10;
+    }
+
+    void CTestOutputParser::feed(const char* data, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            if (data[i] != '\n') {
+                m_line += data[i];
+                continue;
+            }
+            TestRecord record;
+            if (parse_line(m_line, record))
+                m_records.push_back(std::move(record));
+            m_line.clear();
+        }
+    }
+
+    bool CTestOutputParser::parse_line(const std::string& line, TestRecord& record) {
+        // quick reject, most lines are the output of failing tests
+        if (line.find(" sec") == std::string::npos || line.find("Test") == std::string::npos)
+            return false;
+        static const std::regex reg(
+            R"(^\s*\d+/\d+\s+Test\s+#\d+:\s+(.*?) \.*\s*(?:\*\*\*)?(.*?)\s+([0-9.]+) sec)");
+        std::smatch match;
+        if (!std::regex_search(line, match, reg))
+            return false;
+        record.name     = match[1];
+        record.status   = match[2];
+        record.seconds  = std::strtod(match[3].str().c_str(), nullptr);
+        return !record.name.empty() && !record.status.empty();
+    }
+
+    TestHistory::TestHistory(BuildStore& store) : m_store(store) {
+        if (!m_store.is_open())
+            return;
+        m_ok = m_store.db().exec(R"(CREATE TABLE IF NOT EXISTS test_history (
+            name TEXT PRIMARY KEY,
+            runs INTEGER NOT NULL,
+            average_seconds REAL NOT NULL,
+            last_seconds REAL NOT NULL,
+            last_failed INTEGER NOT NULL,
+            last_run INTEGER NOT NULL
+        ))") == SQLITE_OK;
+    }
+
+    void TestHistory::record(const std::vector<TestRecord>& records) {
+        if (!m_ok)
+            return;
+        auto& db = m_store.db();
+        try {
+            db.exec("BEGIN");
+            auto statement = db.prepare(R"(INSERT INTO test_history
+                    (name, runs, average_seconds, last_seconds, last_failed, last_run)
+                VALUES (?1, 1, ?2, ?2, ?3, strftime('%s','now'))
+                ON CONFLICT(name) DO UPDATE SET
+                    runs = runs + 1,
+                    average_seconds = (average_seconds*min(runs, ?4) + ?2)/(min(runs, ?4) + 1),
+                    last_seconds = ?2,
+                    last_failed = ?3,
+                    last_run = strftime('%s','now'))");
+            for (auto& record : records) {
+                if (!record.ran())
+                    continue;
+                statement.bind_text(1, record.name);
+                statement.bind_double(2, record.seconds);
+                statement.bind_int(3, record.failed()? 1 : 0);
+                statement.bind_int(4, kAverageRuns - 1);
+                statement.step();
+                statement.reset();
+            }
+            db.exec("COMMIT");
+        } catch (std::exception&) {
+            db.exec("ROLLBACK");
+        }
+    }
+
+    void TestHistory::write_cost_data(const std::string& build_dir) {
+        if (!m_ok)
+            return;
+        // name -> "runs cost", ctest splits the lines at spaces
+        std::map<std::string, std::string> costs;
+        std::set<std::string> failed;
+        try {
+            auto statement = m_store.db().prepare(
+                "SELECT name, runs, average_seconds, last_failed FROM test_history");
+            while (statement.step() == SQLITE_ROW) {
+                std::string name = statement.column_text(0);
+                if (name.find(' ') != std::string::npos)
+                    continue;
+                std::ostringstream cost;
+                cost << statement.column_int(1) << " " << statement.column_double(2);
+                costs[name] = cost.str();
+                if (statement.column_int(3))
+                    failed.insert(name);
+            }
+        } catch (std::exception&) {
+            return;
+        }
+        if (costs.empty())
+            return;
+
+        std::string path = tea::join_path(build_dir, "Testing/Temporary/CTestCostData.txt");
+        std::ifstream existing(path);
+        std::string line;
+        while (std::getline(existing, line)) {
+            if (line == "---")
+                break;
+            size_t space = line.find(' ');
+            if (space != std::string::npos && costs.count(line.substr(0, space)) == 0)
+                costs[line.substr(0, space)] = line.substr(space + 1);
+        }
+        existing.close();
+
+        tea::mkdir_p(tea::dirname(path));
+        std::ofstream out(path);
+        for (auto& cost : costs)
+            out << cost.first << " " << cost.second << "\n";
+        out << "---\n";
+        for (auto& name : failed)
+            out << name << "\n";
+    }
+
+    std::vector<std::string> test_report(const std::vector<TestRecord>& records) {
+        if (records.empty())
+            return {};
+        int passed = 0, failed = 0, not_run = 0, skipped = 0;
+        double seconds = 0;
+        for (auto& record : records) {
+            if (record.not_run())
+                ++not_run;
+            else if (!record.ran())
+                ++skipped;
+            else if (record.failed())
+                ++failed;
+            else
+                ++passed;
+            seconds += record.seconds;
+        }
+        std::string summary = "[tests] " + std::to_string(passed) + " passed, "
+            + std::to_string(failed) + " failed";
+        if (not_run > 0)
+            summary += ", " + std::to_string(not_run) + " not run";
+        if (skipped > 0)
+            summary += ", " + std::to_string(skipped) + " skipped";
+        summary += ", " + nice_time(seconds) + " of test time";
+        std::vector<std::string> lines = {summary};
+
+        size_t listed = 0;
+        for (auto& record : records) {
+            if (!record.failed() || listed++ >= kReportedFailures)
+                continue;
+            lines.push_back("    " + record.status + " " + record.name);
+        }
+        // disabled ones were meant not to run
+        listed = 0;
+        for (auto& record : records) {
+            if (!record.not_run() || record.disabled() || listed++ >= kReportedFailures)
+                continue;
+            lines.push_back("    Not Run " + record.name);
+        }
+        std::vector<TestRecord> slowest = records;
+        std::sort(slowest.begin(), slowest.end(), [](const TestRecord& a, const TestRecord& b) {
+            return a.seconds > b.seconds;
+        });
+        for (size_t i = 0; i < slowest.size() && i < kReportedSlowest; ++i)
+            lines.push_back("    " + nice_time(slowest[i].seconds) + " " + slowest[i].name);
+        return lines;
+    }
+}
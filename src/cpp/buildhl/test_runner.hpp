@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace buildhl {
+    class BuildStore;
+
+    /** Result of one test as ctest printed it. */
+    struct TestRecord {
+        std::string name;
+        /** Passed, Failed, Timeout, Not Run, Not Run (Disabled), Skipped,
+            Exception: ...
+        */
+        std::string status;
+        double      seconds = 0;
+
+        /** the test ran, so its time says something */
+        bool ran() const { return !not_run() && status != "Skipped"; }
+        bool failed() const { return ran() && status != "Passed"; }
+        /** ctest didn't start it, e.g. the executable is missing or a
+            fixture or test it depends on failed
+        */
+        bool not_run() const { return status.compare(0, 7, "Not Run") == 0; }
+        bool disabled() const { return status == "Not Run (Disabled)"; }
+    };
+
+    /** Collects the results of ctest from its output as it goes by.
+
+        Lines look like " 3/12 Test  #3: name ......***Failed    0.52 sec".
+    */
+    class CTestOutputParser {
+    public:
+        void feed(const char* data, size_t size);
+        /** @return false if line isn't the result of a test */
+        static bool parse_line(const std::string& line, TestRecord& record);
+
+        const std::vector<TestRecord>& records() const { return m_records; }
+    private:
+        std::string             m_line;
+        std::vector<TestRecord> m_records;
+    };
+
+    /** How long tests took and whether they failed in previous runs, kept
+        in the test_history table of the build store.
+    */
+    class TestHistory {
+    public:
+        TestHistory(BuildStore& store);
+
+        void record(const std::vector<TestRecord>& records);
+
+        /** Writes Testing/Temporary/CTestCostData.txt for ctest to start the
+            tests that failed last time first, then the longest ones, so the
+            slowest test doesn't start last and failures show early.
+            Tests ctest knows that aren't in the history are kept.
+        */
+        void write_cost_data(const std::string& build_dir);
+    private:
+        BuildStore& m_store;
+        bool        m_ok = false;
+    };
+
+    /** @return lines for the build summary, failures, tests that didn't
+                run and the slowest tests
+    */
+    std::vector<std::string> test_report(const std::vector<TestRecord>& records);
+}
@@ -0,0 +1,246 @@
+#include "time_trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <nlohmann/json.hpp>
+
+#include "highlight.hpp"
+
+namespace fs = std::filesystem;
+
+namespace buildhl {
+    namespace {
+        struct Accumulator {
+            double  micro_seconds   = 0;
+            int     count           = 0;
+        };
+        typedef std::unordered_map<std::string, Accumulator> AccumulatorMap;
+
+        struct Aggregate {
+            int             files       = 0;
+            double          frontend    = 0;
+            double          backend     = 0;
+            AccumulatorMap  headers;
+            AccumulatorMap  instantiations;
+
+            void merge(Aggregate& other) {
+                files       += other.files;
+                frontend    += other.frontend;
+                backend     += other.backend;
+                for (auto& pair : other.headers) {
+                    auto& acc = headers[pair.first];
+                    acc.micro_seconds += pair.second.micro_seconds;
+                    acc.count += pair.second.count;
+                }
+                for (auto& pair : other.instantiations) {
+                    auto& acc = instantiations[pair.first];
+                    acc.micro_seconds += pair.second.micro_seconds;
+                    acc.count += pair.second.count;
+                }
+            }
+        };
+
+        /*  Streams through a trace file keeping only the event being parsed
+            so huge traces don't need a DOM.
+
+            {"traceEvents": [{"ph": "X", "name": "Source", "dur": 12,
+                "args": {"detail": "/usr/include/stdio.h"}}, ...]}
+        */
+        struct TraceSax : nlohmann::json_sax<nlohmann::json> {
+            TraceSax(Aggregate& aggregate) : m_aggregate(aggregate) {}
+
+            bool null() override { return true; }
+            bool boolean(bool) override { return true; }
+            bool number_integer(number_integer_t val) override {
+                return number(val);
+            }
+            bool number_unsigned(number_unsigned_t val) override {
+                return number(val);
+            }
+            bool number_float(number_float_t val, const string_t&) override {
+                return number(val);
+            }
+            bool string(string_t& val) override {
+                if (m_depth == 2 && m_key == "name")
+                    m_name = std::move(val);
+                else if (m_depth == 2 && m_key == "ph")
+                    m_phase = std::move(val);
+                else if (m_depth == 3 && m_key == "detail")
+                    m_detail = std::move(val);
+                return true;
+            }
+            bool binary(binary_t&) override { return true; }
+            bool start_object(std::size_t) override {
+                ++m_depth;
+                if (m_depth == 2) {
+                    m_name.clear();
+                    m_phase.clear();
+                    m_detail.clear();
+                    m_duration = 0;
+                }
+                return true;
+            }
+            bool key(string_t& val) override {
+                m_key = std::move(val);
+                return true;
+            }
+            bool end_object() override {
+                if (m_depth == 2)
+                    commit_event();
+                --m_depth;
+                return true;
+            }
+            bool start_array(std::size_t) override { return true; }
+            bool end_array() override { return true; }
+            bool parse_error(std::size_t, const std::string&,
+                const nlohmann::detail::exception&) override {
+                return false;
+            }
+        private:
+            bool number(double val) {
+                if (m_depth == 2 && m_key == "dur")
+                    m_duration = val;
+                return true;
+            }
+            void commit_event() {
+                if (m_phase != "X")
+                    return;
+                if (m_name == "Source") {
+                    auto& acc = m_aggregate.headers[m_detail];
+                    acc.micro_seconds += m_duration;
+                    ++acc.count;
+                } else if (m_name == "InstantiateClass" || m_name == "InstantiateFunction") {
+                    auto& acc = m_aggregate.instantiations[m_detail];
+                    acc.micro_seconds += m_duration;
+                    ++acc.count;
+                } else if (m_name == "Frontend") {
+                    m_aggregate.frontend += m_duration;
+                } else if (m_name == "Backend") {
+                    m_aggregate.backend += m_duration;
+                }
+            }
+
+            Aggregate&  m_aggregate;
+            int         m_depth     = 0;
+            std::string m_key;
+            std::string m_name;
+            std::string m_phase;
+            std::string m_detail;
+            double      m_duration  = 0;
+        };
+
+        std::vector<TimeTraceEntry> ranked(const AccumulatorMap& map) {
+            std::vector<TimeTraceEntry> result;
+            result.reserve(map.size());
+            for (auto& pair : map) {
+                result.push_back({pair.first, pair.second.micro_seconds/1e6, pair.second.count});
+            }
+            std::sort(result.begin(), result.end(), [](const TimeTraceEntry& a, const TimeTraceEntry& b) {
+                return a.seconds > b.seconds;
+            });
+            return result;
+        }
+    }
+
+    std::string time_trace_cmake_include() {
+        return R"(# generated by buildhl --time-trace
+if(BUILDHL_PROJECT_INCLUDE)
+    include("${BUILDHL_PROJECT_INCLUDE}")
+endif()
+foreach(lang C CXX)
+    if(CMAKE_${lang}_COMPILER_ID MATCHES "Clang")
+        if(CMAKE_${lang}_COMPILER_FRONTEND_VARIANT STREQUAL "MSVC")
+            add_compile_options($<$<COMPILE_LANGUAGE:${lang}>:/clang:-ftime-trace>)
+        else()
+            add_compile_options($<$<COMPILE_LANGUAGE:${lang}>:-ftime-trace>)
+        endif()
+    endif()
+endforeach()
+)";
+    }
+
+    std::vector<std::string> find_time_traces(const std::string& build_dir) {
+        std::vector<std::string> result;
+        std::error_code ec;
+        fs::recursive_directory_iterator it(build_dir, fs::directory_options::skip_permission_denied, ec);
+        for (; !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            const fs::path& path = it->path();
+            if (path.extension() != ".json")
+                continue;
+            // clang puts foo.cpp.json next to foo.cpp.o
+            fs::path object = path;
+            object.replace_extension(".o");
+            fs::path object_msvc = path;
+            object_msvc.replace_extension(".obj");
+            std::error_code exists_ec;
+            if (fs::exists(object, exists_ec) || fs::exists(object_msvc, exists_ec))
+                result.push_back(path.string());
+        }
+        return result;
+    }
+
+    TimeTraceReport aggregate_time_traces(const std::vector<std::string>& files) {
+        int thread_count = std::max(1u, std::thread::hardware_concurrency());
+        thread_count = std::min<int>(thread_count, files.size());
+
+        Aggregate total;
+        std::mutex mutex;
+        std::atomic<size_t> next_file{0};
+        auto worker = [&]() {
+            Aggregate local;
+            while (true) {
+                size_t index = next_file++;
+                if (index >= files.size())
+                    break;
+                std::ifstream input(files[index], std::ios::binary);
+                if (!input)
+                    continue;
+                TraceSax sax(local);
+                if (nlohmann::json::sax_parse(input, &sax))
+                    ++local.files;
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            total.merge(local);
+        };
+        std::vector<std::thread> threads;
+        for (int i = 0; i < thread_count; ++i)
+            threads.emplace_back(worker);
+        for (auto& thread : threads)
+            thread.join();
+
+        TimeTraceReport report;
+        report.files            = total.files;
+        report.frontend         = total.frontend/1e6;
+        report.backend          = total.backend/1e6;
+        report.headers          = ranked(total.headers);
+        report.instantiations   = ranked(total.instantiations);
+        return report;
+    }
+
+    std::vector<std::string> TimeTraceReport::to_lines(int top) const {
+        std::vector<std::string> lines;
+        if (files == 0)
+            return {"[time trace] no -ftime-trace output found, only clang supports it"};
+        lines.push_back("[time trace] " + std::to_string(files) + " translation units, frontend "
+            + nice_time(frontend) + ", backend " + nice_time(backend));
+        auto add_section = [&](const char* title, const std::vector<TimeTraceEntry>& entries, const char* unit) {
+            if (entries.empty())
+                return;
+            lines.push_back(std::string("[time trace] ") + title);
+            for (int i = 0; i < top && i < (int)entries.size(); ++i) {
+                auto& entry = entries[i];
+                lines.push_back("    " + nice_time(entry.seconds) + " in "
+                    + std::to_string(entry.count) + unit + entry.name);
+            }
+        };
+        add_section("most expensive headers", headers, " TUs  ");
+        add_section("most expensive template instantiations", instantiations, " times  ");
+        return lines;
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace buildhl {
+    /** One aggregated hot spot from clang -ftime-trace output */
+    struct TimeTraceEntry {
+        std::string name;
+        /** inclusive time summed over all translation units */
+        double      seconds = 0;
+        /** how many translation units it showed up in */
+        int         count   = 0;
+    };
+
+    struct TimeTraceReport {
+        int                         files       = 0;
+        double                      frontend    = 0;
+        double                      backend     = 0;
+        /** Source events, headers sorted most expensive first */
+        std::vector<TimeTraceEntry> headers;
+        /** InstantiateClass/InstantiateFunction events, most expensive first */
+        std::vector<TimeTraceEntry> instantiations;
+
+        /** @return human readable ranked report of the top entries. */
+        std::vector<std::string> to_lines(int top=10) const;
+    };
+
+    /** Contents for CMAKE_PROJECT_INCLUDE that adds -ftime-trace for clang.
+        It includes BUILDHL_PROJECT_INCLUDE first, the include the user set.
+    */
+    std::string time_trace_cmake_include();
+
+    /** @return all clang time trace files found in the build dir. */
+    std::vector<std::string> find_time_traces(const std::string& build_dir);
+
+    /** SAX parses the trace files in parallel and aggregates them. */
+    TimeTraceReport aggregate_time_traces(const std::vector<std::string>& files);
+}
@@ -2,18 +2,27 @@
 #include <cstring>
 #include <teaport_utils/fileutils.hpp>
 #include <subprocess.hpp>
+#include <atomic>
 #include <mutex>
 #include <thread>
+#include <algorithm>
 
 #ifdef _WIN32
 #include <windows.h>
 #endif
 
 #include "buildhl/highlight.hpp"
+#include "buildhl/ansi_escapes.hpp"
 
 #include "buildhl/project_detect.hpp"
 #include "buildhl/FileFilter.hpp"
+#include "buildhl/LineReader.hpp"
 #include "buildhl/ProgressAnalyser.hpp"
+#include "buildhl/include_analysis.hpp"
+#include "buildhl/ResourceMonitor.hpp"
+#include "buildhl/BuildStore.hpp"
+#include "buildhl/job_count.hpp"
+#include "buildhl/system_info.hpp"
 
 using namespace buildhl;
 
@@ -44,15 +53,22 @@ std::string dirname(std::string path) {
     return path.substr(0, slash_pos);
 }
 
+namespace {
+    /** how often a build that prints nothing is checked for signals */
+    constexpr double kSignalCheckSeconds = 0.1;
+}
+
 class StreamProcessor {
 public:
     StreamProcessor(){
+        m_streams.push_back(std::make_unique<Stream>());
         process_line("[build start]");
         std::string absolute_str = subprocess::cenv["BUILDHL_ABSOLUTE"];
         bool absolute = !absolute_str.empty() && absolute_str != "0";
         m_file_filter.set_always_absolute(absolute);
     }
     StreamProcessor(const std::string log_file) {
+        m_streams.push_back(std::make_unique<Stream>());
         std::string dir = dirname(log_file);
         if (!tea::path_exists(dir)) {
             try {
@@ -78,7 +94,29 @@ public:
             m_active = false;
         }
         close_thread();
-        m_progress.clear();
+        for (auto& stream : m_streams)
+            stream->progress.clear();
+        if (!m_usages.empty()) {
+            process_line("[memory] peak " + nice_bytes(m_peak_rss) + ", top consumers");
+            std::sort(m_usages.begin(), m_usages.end(), [](const InvocationUsage& a, const InvocationUsage& b) {
+                return a.peak_rss > b.peak_rss;
+            });
+            for (size_t i = 0; i < m_usages.size() && i < 5; ++i) {
+                auto& usage = m_usages[i];
+                process_line("    " + nice_bytes(usage.peak_rss) + " "
+                    + nice_time(usage.cpu_seconds) + " cpu in " + usage.name);
+            }
+        }
+        if (m_tools_waited > 0)
+            process_line(cpu_summary());
+        for (auto& stream : m_streams) {
+            if (stream->tag.empty())
+                continue;
+            std::string line = "[" + stream->tag + "] " + std::to_string(stream->errors) + " errors "
+                + std::to_string(stream->warnings) + " warnings in " + nice_time(stream->seconds);
+            log(line);
+            print_line(line);
+        }
         std::string message = std::to_string(m_total_errors) + " errors " + std::to_string(m_total_warnings) + " warnings";
         process_line(message);
         std::string total_build = "total build time: " + nice_time(m_stop_watch.seconds());
@@ -99,9 +137,31 @@ public:
         }
     }
 
-    void process_line(std::string line) {
+    /** @param stream   what add_stream() returned, 0 is the untagged one */
+    void process_line(std::string line, int stream_index=0) {
         if (line.empty())
             return;
+        Stream& stream = *m_streams[stream_index];
+        // the tool's own escapes are put aside, all below sees the text only
+        std::vector<Escape> escapes;
+        if (line.find('\x1b') != std::string::npos) {
+            EscapedText escaped = split_escapes(line);
+            line = std::move(escaped.visible);
+            escapes = std::move(escaped.escapes);
+        }
+        size_t status_length = 0;
+        Progress progress = parse_line_progress(line, stream, &status_length);
+        if (status_length > 0) {
+            std::string status = "[" + std::to_string((int)progress.complete) + "/"
+                + std::to_string((int)progress.total) + "] ";
+            line = status + line.substr(status_length);
+            shift_escapes(escapes, status_length, status.size());
+        }
+        if (!stream.tag.empty()) {
+            std::string tag = "[" + stream.tag + "] ";
+            line = tag + line;
+            shift_escapes(escapes, 0, tag.size());
+        }
         log(line);
         lex::StaticString line_ss(line.c_str());
 
@@ -111,30 +171,54 @@ public:
             auto upper = str.to_upper();
             if (upper == "ERROR") {
                 ++m_total_errors;
+                ++stream.errors;
                 break;
             } else if (upper == "WARNING") {
                 ++m_total_warnings;
+                ++stream.warnings;
                 break;
             }
         }
-        Progress progress = parse_progress(line);
-
-        line = m_file_filter.filter(line);
-        line = color_line(line);
-        enableColors();
-        if (m_last_is_progress) {
-            std::cout << '\r';
-            bcolors colors;
-            std::cout << colors.CLEAR_LINE;
-        }
-        std::cout << line;
-        if (line[line.size()-1] != '\n')
-            std::cout << '\n';
+        if (m_strip_input_colors || !has_colors(escapes))
+            print_line(line);
+        else
+            print_colored_line(line, escapes);
 
         if (progress > 0) {
-            m_progress.complete(progress);
+            stream.progress.complete(progress);
         }
-        m_last_is_progress  = false;
+    }
+
+    /** A status the tool overwrote with "\r", it only moves the progress.
+        It is never printed, logged or looked at for errors.
+    */
+    void process_overwritten(const std::string& status, int stream_index=0) {
+        Stream& stream = *m_streams[stream_index];
+        size_t status_length = 0;
+        Progress progress = parse_line_progress(status, stream, &status_length);
+        if (progress > 0)
+            stream.progress.complete(progress);
+    }
+
+    /** Print a line of buildhl's own reports. Not counted as build output. */
+    void report_line(const std::string& line) {
+        if (line.empty())
+            return;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        log(line);
+        print_line(line);
+    }
+
+    /** Adds a stream to process concurrently with the others, its lines
+        are prefixed by tag and it gets its own progress bar.
+
+        @return index for process()
+    */
+    int add_stream(const std::string& tag) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_streams.push_back(std::make_unique<Stream>());
+        m_streams.back()->tag = tag;
+        return m_streams.size() - 1;
     }
 
     void update_progress_line() {
@@ -143,11 +227,33 @@ public:
             bcolors colors;
             std::cout << colors.CLEAR_LINE;
         }
-        if (m_progress.size() > 0) {
-            double progress = m_progress.progress();
-            std::string pline = render_progress(progress, 20);
-            pline = left_pad(std::to_string((int)(progress*100)), 3) + "% " + pline;
-            pline += " " + nice_time(m_progress.eta()) + " eta";
+        std::string pline;
+        int64_t rss = 0;
+        double eta = 0;
+        for (auto& stream : m_streams) {
+            if (stream->monitor != nullptr)
+                rss += stream->monitor->current_rss();
+            if (stream->progress.size() == 0)
+                continue;
+            double progress = stream->progress.progress();
+            if (!pline.empty())
+                pline += "  ";
+            if (!stream->tag.empty())
+                pline += stream->tag + " ";
+            // several bars have to share the line
+            pline += left_pad(std::to_string((int)(progress*100)), 3) + "% "
+                + render_progress(progress, m_streams.size() > 2? 10 : 20);
+            if (stream->running >= 0)
+                pline += " " + std::to_string(stream->running) + " running";
+            eta = std::max(eta, stream->progress.eta());
+        }
+        if (!pline.empty()) {
+            if (rss > 0)
+                pline += " " + nice_bytes(rss);
+            pline += " " + nice_time(eta) + " eta";
+            // a line that wraps can't be cleared with \r
+            if (m_window_size.columns > 1)
+                pline = fit_width(pline, m_window_size.columns - 1);
             if (pline != m_progress_line || !m_last_is_progress) {
                 m_progress_line = pline;
                 std::cout << pline;
@@ -160,31 +266,68 @@ public:
 
     }
 
-    void process(InputStream& input) {
+    /** Processes the output of input until it ends. Several threads may
+        process different streams at once.
+    */
+    void process(InputStream& input, int stream_index=0) {
+        auto pinput = dynamic_cast<PopenInputStream*>(&input);
+        if (pinput != nullptr) {
+            start_monitor(pinput->popen().pid, stream_index);
+            set_pty(stream_index, pinput->popen().cout);
+        }
         start_update_thread_ifneeded();
         int signal_code = 0;
+        LineReader reader(input);
+        std::string line;
         while (true) {
             try {
                 tea::throw_signal_ifneeded();
             } catch (tea::SignalError& err) {
                 signal_code = err.code();
-                if (auto pinput = dynamic_cast<PopenInputStream*>(&input); pinput) {
+                if (pinput != nullptr) {
                     std::cout << "sending signal " << signal_code << "\n";
                     pinput->popen().send_signal(signal_code);
                     // tell it to die too
                     pinput->popen().terminate();
                 }
             }
-            std::string line = buildhl::getline(input);
-            if (line.empty())
+            // wake up for signals while the tool is quiet, and stop once it
+            // exited even if a daemon it started holds on to the pipe
+            if (pinput != nullptr && !reader.buffered()) {
+                auto ready = pinput->wait(kSignalCheckSeconds);
+                if (ready == PopenInputStream::Ready::timeout)
+                    continue;
+                if (ready == PopenInputStream::Ready::exited)
+                    reader.end_input();
+            }
+            // polled, so only read once. A status without "\n" shows up
+            // as partial right away instead of when the next one starts.
+            auto kind = reader.next(line, pinput == nullptr);
+            if (kind == LineReader::Kind::end)
                 break;
             std::unique_lock<std::mutex> lock(m_mutex);
-            process_line(line);
+            if (kind == LineReader::Kind::overwritten || kind == LineReader::Kind::partial)
+                process_overwritten(line, stream_index);
+            else
+                process_line(line, stream_index);
         }
-        if (m_last_is_progress) {
-            std::cout << '\r';
-            bcolors colors;
-            std::cout << colors.CLEAR_LINE << std::flush;
+        stop_monitor(stream_index);
+        set_pty(stream_index, subprocess::kBadPipeValue);
+        if (pinput != nullptr && signal_code == 0) {
+            // reaping it here gets us what it used
+            pinput->popen().wait();
+            std::unique_lock<std::mutex> lock(m_mutex);
+            add_tool_usage(pinput->popen().usage);
+        }
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_streams[stream_index]->seconds = m_streams[stream_index]->stop_watch.seconds();
+            if (m_last_is_progress) {
+                std::cout << '\r';
+                bcolors colors;
+                std::cout << colors.CLEAR_LINE << std::flush;
+                m_last_is_progress = false;
+            }
         }
         if (signal_code) {
             throw tea::SignalError(signal_code);
@@ -197,8 +340,168 @@ public:
     void set_base_dir(const std::string& str) {
         m_file_filter.set_base_dir(str);
     }
+    /** resources used by the invocations of processed commands */
+    const std::vector<InvocationUsage>& usages() const {
+        return m_usages;
+    }
+    /** resources used by the invocations of one stream */
+    const std::vector<InvocationUsage>& usages(int stream_index) const {
+        return m_streams[stream_index]->usages;
+    }
+    /** drop the colors of the tools and color their lines like the others */
+    void set_strip_input_colors(bool strip) {
+        m_strip_input_colors = strip;
+    }
+    /** seconds between memory samples of processed commands, 0 disables */
+    void set_monitor_interval(double interval) {
+        m_monitor_interval = interval;
+    }
 private:
+    struct Stream {
+        /** prefix of its lines, empty for the only stream of a build */
+        std::string tag;
+        ProgressGraph progress;
+        /** jobs running as reported by the build tool, -1 if unknown */
+        int running = -1;
+        std::unique_ptr<ResourceMonitor> monitor;
+        subprocess::StopWatch stop_watch;
+        /** time until the last input of the stream ended */
+        double seconds = 0;
+        int errors = 0;
+        int warnings = 0;
+        std::vector<InvocationUsage> usages;
+        /** terminal the build tool writes to, resized with ours */
+        subprocess::PipeHandle pty = subprocess::kBadPipeValue;
+    };
+
+    /** Progress a line reports, by the prefix of our NINJA_STATUS or else
+        by its text. Updates the jobs running in the stream.
+
+        @param status_length    set to the length of the NINJA_STATUS prefix
+    */
+    Progress parse_line_progress(const std::string& line, Stream& stream, size_t* status_length) {
+        Progress progress = parse_ninja_status(line, status_length);
+        if (*status_length > 0) {
+            stream.running = progress.running;
+            return progress;
+        }
+        return parse_progress(line);
+    }
+
+    /** @param output  what the build tool of the stream writes to */
+    void set_pty(int stream_index, subprocess::PipeHandle output) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+#ifndef _WIN32
+        // a pipe has no window size
+        if (output != subprocess::kBadPipeValue && subprocess::pipe_window_size(output).columns == 0)
+            output = subprocess::kBadPipeValue;
+#else
+        output = subprocess::kBadPipeValue;
+#endif
+        m_streams[stream_index]->pty = output;
+    }
+    /** passes a resize of our terminal on to the ptys, with m_mutex held */
+    void update_window_size() {
+#ifndef _WIN32
+        auto size = subprocess::pipe_window_size(subprocess::kStdOutValue);
+        if (size == m_window_size || size.columns == 0)
+            return;
+        m_window_size = size;
+        for (auto& stream : m_streams) {
+            if (stream->pty != subprocess::kBadPipeValue)
+                subprocess::pipe_set_window_size(stream->pty, size);
+        }
+#endif
+    }
+
+    void start_monitor(subprocess::pid_t pid, int stream_index) {
+        if (m_monitor_interval <= 0 || !ResourceMonitor::supported())
+            return;
+        auto monitor = std::make_unique<ResourceMonitor>(pid, m_monitor_interval);
+        monitor->start();
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_streams[stream_index]->monitor = std::move(monitor);
+    }
+    void stop_monitor(int stream_index) {
+        std::unique_ptr<ResourceMonitor> monitor;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            monitor = std::move(m_streams[stream_index]->monitor);
+        }
+        if (monitor == nullptr)
+            return;
+        monitor->stop();
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_peak_rss = std::max(m_peak_rss, monitor->peak_rss());
+        for (auto& usage : monitor->invocations()) {
+            if (usage.peak_rss > 0) {
+                m_streams[stream_index]->usages.push_back(usage);
+                m_usages.push_back(std::move(usage));
+            }
+        }
+    }
+    void add_tool_usage(const subprocess::ResourceUsage& usage) {
+        ++m_tools_waited;
+        m_tool_usage.user_seconds           += usage.user_seconds;
+        m_tool_usage.system_seconds         += usage.system_seconds;
+        m_tool_usage.max_rss                = std::max(m_tool_usage.max_rss, usage.max_rss);
+        m_tool_usage.voluntary_switches     += usage.voluntary_switches;
+        m_tool_usage.involuntary_switches   += usage.involuntary_switches;
+    }
+    /** Whether the build kept the CPUs busy. Few CPUs busy means it was
+        serialized, many involuntary switches that it was starved of CPUs.
+    */
+    std::string cpu_summary() {
+        const auto& usage = m_tool_usage;
+        double wall = std::max(m_stop_watch.seconds(), 0.001);
+        double busy = usage.cpu_seconds()/wall;
+        int cpus = std::max(cpu_count(), 1);
+        char busy_str[32];
+        snprintf(busy_str, sizeof(busy_str), "%.1f", busy);
+        std::string line = "[cpu] " + nice_time(usage.cpu_seconds()) + " cpu ("
+            + nice_time(usage.system_seconds) + " sys) in " + nice_time(wall)
+            + ", " + busy_str + " of " + std::to_string(cpus) + " cpus busy ("
+            + std::to_string((int)(100*busy/cpus)) + "%)";
+        if (usage.max_rss > 0)
+            line += ", largest process " + nice_bytes(usage.max_rss);
+        if (usage.voluntary_switches + usage.involuntary_switches > 0) {
+            line += ", " + std::to_string(usage.involuntary_switches) + " of "
+                + std::to_string(usage.voluntary_switches + usage.involuntary_switches)
+                + " context switches forced";
+        }
+        return line;
+    }
+    void print_line(std::string line) {
+        line = m_file_filter.filter(line);
+        line = color_line(line);
+        write_line(line);
+    }
+    /** A line the tool colored itself. Only the paths are rewritten, our
+        colors would break up the tool's.
+    */
+    void print_colored_line(const std::string& line, const std::vector<Escape>& escapes) {
+        std::string output = join_escapes(line, escapes, [this](const std::string& run) {
+            return m_file_filter.filter(run);
+        });
+        if (!output.empty() && output.back() == '\n')
+            output.pop_back();
+        bcolors colors;
+        write_line(output + colors.ENDC);
+    }
+    void write_line(const std::string& line) {
+        enableColors();
+        if (m_last_is_progress) {
+            std::cout << '\r';
+            bcolors colors;
+            std::cout << colors.CLEAR_LINE;
+        }
+        std::cout << line;
+        if (line[line.size()-1] != '\n')
+            std::cout << '\n';
+        m_last_is_progress  = false;
+    }
     void start_update_thread_ifneeded() {
+        std::unique_lock<std::mutex> lock(m_mutex);
         if (m_update_thread.joinable())
             return;
         m_update_thread = std::thread([this] () {
@@ -207,6 +510,7 @@ private:
                 std::unique_lock<std::mutex> lock(m_mutex);
                 if (!m_active)
                     break;
+                update_window_size();
                 update_progress_line();
             }
         });
@@ -218,12 +522,21 @@ private:
     OutputStream_uptr m_log_file;
     FileFilter m_file_filter;
     subprocess::StopWatch m_stop_watch;
-    ProgressGraph m_progress;
     bool m_last_is_progress = false;
     std::mutex m_mutex;
     std::thread m_update_thread;
     bool m_active = true;
     std::string m_progress_line;
+    subprocess::WindowSize m_window_size;
+    double m_monitor_interval = 0;
+    bool m_strip_input_colors = false;
+    /** unique_ptr so streams stay put while others are added */
+    std::vector<std::unique_ptr<Stream>> m_streams;
+    std::vector<InvocationUsage> m_usages;
+    int64_t m_peak_rss = 0;
+    /** summed over the build tools that were waited for, max_rss is the max */
+    subprocess::ResourceUsage m_tool_usage;
+    int m_tools_waited = 0;
 
     int m_total_errors      = 0;
     int m_total_warnings    = 0;
@@ -275,18 +588,327 @@ options:
     --target    The target to build. If ommitted, it's ommited being specified
                 when running build command.
     --dir       add additional search path for file rewriting.
+    --analyze-includes
+                Don't build. For ninja builds list the headers whose
+                modification would cost the most rebuild time, based on
+                .ninja_deps and compile times in .ninja_log.
+    --refresh-env
+                Run the env_script of buildhl.json even if its result for
+                the same command line, script contents and PATH is cached.
+    --concurrent
+                Build every build type and target given at once, e.g.
+                "buildhl --concurrent debug release test". Lines are tagged
+                with the build they are from and each build gets its own
+                progress bar. The jobs are split between the builds or,
+                with --jobserver, shared through one jobserver. Builds of
+                the same build dir still run one after the other.
+    --multi-config
+                Configure one build dir, build/multi, with the Ninja
+                Multi-Config generator and build the build type as its
+                configuration, so switching between debug and release
+                doesn't configure again. Without ninja or with a single
+                config generator given by -G the build dir is
+                build/<build type> as without it.
+    --fast-linker
+                When configuring a new build dir link with mold or lld if
+                the compiler can, checked once by linking a test program.
+                The time link steps took is reported after the build.
+    --no-compiler-cache
+                Don't make ccache or sccache the compiler launcher when
+                configuring. By default one found on PATH is used unless the
+                launcher is already set or the cache isn't local. The hit
+                rate is reported after the build.
+    --jobserver
+                Run a GNU make jobserver for the build that hands out fewer
+                job tokens while memory is low or the machine is overloaded.
+                Needs ninja 1.13 and up for ninja builds, -j sets the most
+                jobs.
+    --pty
+                When the output is a terminal run configure and the build
+                on a pseudo terminal, so compilers print each line as soon
+                as it's done and keep their colors. It is resized with the
+                terminal.
+    --strip-input-colors
+                Remove the colors the build tools print and highlight their
+                lines like the others. By default lines a tool colored keep
+                its colors.
+    --time-trace
+                For clang builds compile with -ftime-trace and report the
+                most expensive headers and template instantiations after the
+                build.
 
 Environment variables:
     BUILDHL_MAX_JOBS    When possible this number will be used to specify to
                         builders for the amount of jobs they run concurrently.
+                        If neither it nor -j is given it is picked from the
+                        CPUs and memory available, respecting cgroup limits.
+    BUILDHL_TIME_TRACE  Set to 1 to do the same as --time-trace.
+    BUILDHL_CTEST       The target test runs ctest with -j and --output-on-failure
+                        and reports failed and slow tests. Test times and
+                        failures are remembered so the next run starts the
+                        ones that failed and the longest first. Set to 0 to
+                        build the test target instead.
+    BUILDHL_CONCURRENT  Set to 1 to do the same as --concurrent.
+    BUILDHL_MULTI_CONFIG
+                        Set to 1 to do the same as --multi-config.
+    BUILDHL_FAST_LINKER Set to 1 to do the same as --fast-linker.
+    BUILDHL_COMPILER_CACHE
+                        Set to 0 to do the same as --no-compiler-cache.
+    BUILDHL_DIRECT_BUILD
+                        Set to 0 to build through cmake --build instead of
+                        running ninja or make directly.
+    BUILDHL_JOBSERVER   Set to 1 to do the same as --jobserver.
+    BUILDHL_PTY         Set to 1 to do the same as --pty.
+    BUILDHL_STRIP_INPUT_COLORS
+                        Set to 1 to do the same as --strip-input-colors, also
+                        for "buildhl -".
+    BUILDHL_JOB_MEMORY  Memory a job needs, e.g. 2G. Used to pick the amount
+                        of jobs and by the jobserver. Defaults to what
+                        compiling took in the last build, else 1G.
+    BUILDHL_MONITOR_INTERVAL
+                        Seconds between samples of the memory used by the
+                        build, shown on the progress line. The biggest
+                        consumers are listed at the end. Default 0.5, 0
+                        disables it. Linux only.
 
 These environment variables are set for invocations of buildhl:
     BUILDHL_BUILD_TYPE
     BUILDHL_TARGET
     BUILDHL_PROJECT_DIR
     BUILDHL_MAX_JOBS
+    NINJA_STATUS        For ninja builds unless already set. buildhl decodes
+                        it for the progress line.
 )";
 }
+namespace {
+    /** cenv is global, only one build may change it or spawn at a time */
+    std::mutex g_env_mutex;
+
+    const char* kProgramCacheKey = "find_program";
+
+    /** programs the previous build of the build dir looked up */
+    void load_program_cache(BuildStore& store) {
+        subprocess::find_program_cache_load(store.get(kProgramCacheKey));
+    }
+    /** saves what find_program found for the next build, if anything is new */
+    void save_program_cache(BuildStore& store) {
+        std::string data = subprocess::find_program_cache_save();
+        if (!data.empty() && data != store.get(kProgramCacheKey))
+            store.set(kProgramCacheKey, data);
+    }
+
+    void export_invocation(const InvocationInfo& invocation) {
+        using subprocess::cenv;
+        using std::to_string;
+        cenv["BUILDHL_BUILD_TYPE"]      = to_string(invocation.build_type);
+        cenv["BUILDHL_TARGET"]          = invocation.target;
+        cenv["BUILDHL_PROJECT_DIR"]     = invocation.project_dir;
+        cenv["BUILDHL_MAX_JOBS"]        = to_string(invocation.max_jobs);
+    }
+
+    /** Builds of one build dir, they run one after the other. */
+    struct BuildGroup {
+        std::string                 build_dir;
+        std::unique_ptr<BuildStore> store;
+        std::vector<InvocationInfo> invocations;
+        std::vector<Project_uptr>   projects;
+        std::vector<int>            streams;
+        std::vector<std::string>    tags;
+        int                         status  = 0;
+    };
+
+    /** The processes of all groups so a signal can stop all of them. */
+    struct RunningBuilds {
+        std::mutex mutex;
+        std::vector<PopenInputStream*> inputs;
+        /** read by the groups' threads without the mutex */
+        std::atomic<int> signal_code{0};
+
+        /** @return false if a signal already stopped the build */
+        bool add(InputStream* input) {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (auto pinput = dynamic_cast<PopenInputStream*>(input); pinput)
+                inputs.push_back(pinput);
+            return signal_code == 0;
+        }
+        void remove(InputStream* input) {
+            std::unique_lock<std::mutex> lock(mutex);
+            inputs.erase(std::remove(inputs.begin(), inputs.end(), input), inputs.end());
+        }
+        void signal(int code) {
+            std::unique_lock<std::mutex> lock(mutex);
+            signal_code = code;
+            for (auto input : inputs) {
+                input->popen().send_signal(code);
+                input->popen().terminate();
+            }
+        }
+    };
+
+    /** Runs the builds of a group, configuring first when needed.
+        @return the exit status of the first build that failed
+    */
+    int run_group(BuildGroup& group, StreamProcessor& stream_processor, RunningBuilds& running) {
+        for (size_t i = 0; i < group.projects.size(); ++i) {
+            auto& project = group.projects[i];
+            for (int step = 0; step < 2; ++step) {
+                InputStream_uptr input;
+                {
+                    std::unique_lock<std::mutex> lock(g_env_mutex);
+                    export_invocation(group.invocations[i]);
+                    if (step == 0 && project->should_configure())
+                        input = project->configure(group.invocations[i].configure_options);
+                    else if (step == 1)
+                        input = project->make(group.invocations[i].target);
+                }
+                if (input == nullptr)
+                    continue;
+                if (!running.add(input.get()))
+                    return 1;
+                try {
+                    stream_processor.process(*input, group.streams[i]);
+                } catch (tea::SignalError& err) {
+                    running.signal(err.code());
+                }
+                running.remove(input.get());
+                int status = 0;
+                if (auto pinput = dynamic_cast<PopenInputStream*>(input.get()); pinput)
+                    status = pinput->popen().wait();
+                if (running.signal_code != 0)
+                    return 1;
+                if (step == 0)
+                    project->configured(status);
+                if (status != 0)
+                    return status;
+            }
+        }
+        return 0;
+    }
+
+    std::string variant_tag(const InvocationInfo& variant, const InvocationInfo& invocation) {
+        bool build_types = invocation.build_types.size() > 1;
+        bool targets = invocation.targets.size() > 1;
+        std::string tag = build_types || !targets? to_string(variant.build_type) : "";
+        if (targets && !variant.target.empty())
+            tag += (tag.empty()? "" : ":") + variant.target;
+        return tag;
+    }
+}
+
+/** Builds every combination of build types and targets at once with
+    output tagged by which build it came from. Builds sharing a build dir
+    still run one after the other. The jobs are split between the builds
+    that run at once or, with --jobserver, they share one jobserver.
+*/
+int build_concurrently(const InvocationInfo& invocation) {
+    std::vector<BuildGroup> groups;
+    for (auto& variant : concurrent_invocations(invocation)) {
+        auto project = buildhl::detect_project(variant);
+        if (project == nullptr)
+            return 1;
+        auto group = std::find_if(groups.begin(), groups.end(), [&project](const BuildGroup& group) {
+            return group.build_dir == project->get_build_dir();
+        });
+        if (group == groups.end()) {
+            groups.emplace_back();
+            group = groups.end() - 1;
+            group->build_dir = project->get_build_dir();
+            group->store = std::make_unique<BuildStore>();
+            if (!group->build_dir.empty())
+                group->store->open(group->build_dir);
+        }
+        group->invocations.push_back(variant);
+        group->projects.push_back(std::move(project));
+        group->tags.push_back(variant_tag(variant, invocation));
+    }
+
+    load_program_cache(*groups[0].store);
+    JobCount job_count = decide_job_count(*groups[0].store, invocation.job_memory);
+    int jobs = invocation.max_jobs > 0? invocation.max_jobs : job_count.jobs;
+    std::string job_count_line;
+    if (invocation.max_jobs <= 0)
+        job_count_line = "[jobs] " + job_count.to_string();
+
+    std::shared_ptr<JobServer> job_server;
+    if (invocation.jobserver && JobServer::supported()) {
+        std::string fifo = tea::join_path(groups[0].build_dir, "buildhl/jobserver.fifo");
+        tea::mkdir_p(tea::dirname(fifo));
+        job_server = std::make_shared<JobServer>(jobs, job_count.job_memory);
+        if (!job_server->start(fifo))
+            job_server.reset();
+    }
+    std::string split_line = "[concurrent] " + std::to_string(groups.size()) + " builds at once, ";
+    if (job_server != nullptr)
+        split_line += "sharing a jobserver of " + std::to_string(jobs) + " jobs";
+    else
+        split_line += "splitting " + std::to_string(jobs) + " jobs between them";
+
+    for (size_t i = 0; i < groups.size(); ++i) {
+        int group_jobs = jobs;
+        if (job_server == nullptr) {
+            group_jobs = jobs/groups.size() + (i < jobs % groups.size()? 1 : 0);
+            group_jobs = std::max(group_jobs, 1);
+        }
+        for (size_t j = 0; j < groups[i].projects.size(); ++j) {
+            auto& variant = groups[i].invocations[j];
+            variant.max_jobs    = group_jobs;
+            variant.job_memory  = job_count.job_memory;
+            groups[i].projects[j]->set_invocation(variant);
+            groups[i].projects[j]->set_store(groups[i].store.get());
+            groups[i].projects[j]->set_job_server(job_server);
+        }
+    }
+
+    int status = 0;
+    RunningBuilds running;
+    unblock_signals();
+    {
+        auto& first = groups[0].projects[0];
+        StreamProcessor stream_processor(tea::join_path(first->get_build_dir(), "build.log"));
+        stream_processor.set_base_dir(first->get_project_dir());
+        for (auto& group : groups)
+            stream_processor.add_search_path(group.build_dir);
+        stream_processor.add_search_path(tea::getcwd());
+        stream_processor.set_monitor_interval(invocation.monitor_interval);
+        stream_processor.set_strip_input_colors(invocation.strip_input_colors);
+        stream_processor.report_line(job_count_line);
+        stream_processor.report_line(split_line);
+        for (auto& group : groups) {
+            for (auto& tag : group.tags)
+                group.streams.push_back(stream_processor.add_stream(tag));
+        }
+
+        block_signals();
+        std::vector<std::thread> threads;
+        for (auto& group : groups) {
+            threads.emplace_back([&group, &stream_processor, &running]() {
+                group.status = run_group(group, stream_processor, running);
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+
+        for (auto& group : groups) {
+            std::vector<InvocationUsage> usages;
+            for (size_t i = 0; i < group.projects.size(); ++i) {
+                auto& stream_usages = stream_processor.usages(group.streams[i]);
+                for (auto& line : group.projects[i]->build_report(stream_usages))
+                    stream_processor.report_line("[" + group.tags[i] + "] " + line);
+                usages.insert(usages.end(), stream_usages.begin(), stream_usages.end());
+            }
+            learn_job_memory(*group.store, usages);
+            save_program_cache(*group.store);
+            if (status == 0)
+                status = group.status;
+        }
+        if (job_server != nullptr) {
+            job_server->stop();
+            stream_processor.report_line(job_server->summary());
+        }
+    }
+    return running.signal_code != 0? 1 : status;
+}
+
 int main(int argc, char** argv_in) {
     auto argv = reinterpret_cast<lex::CString*>(argv_in);
 
@@ -312,6 +934,8 @@ int main(int argc, char** argv_in) {
         for (auto path : search_paths) {
             stream_processor.add_search_path(path);
         }
+        std::string strip_input_colors = subprocess::cenv["BUILDHL_STRIP_INPUT_COLORS"];
+        stream_processor.set_strip_input_colors(!strip_input_colors.empty() && strip_input_colors != "0");
         CinStream cin;
         stream_processor.process(cin);
         return 0;
@@ -319,21 +943,45 @@ int main(int argc, char** argv_in) {
 
     std::vector<std::string> args = argv_to_vector(argc, argv);
     InvocationInfo invocation = parse_args(args);
-
-    {
-        using subprocess::cenv;
-        using std::to_string;
-        auto env = subprocess::current_env_copy();
-        cenv["BUILDHL_BUILD_TYPE"]      = to_string(invocation.build_type);
-        cenv["BUILDHL_TARGET"]          = invocation.target;
-        cenv["BUILDHL_PROJECT_DIR"]     = invocation.project_dir;
-        cenv["BUILDHL_MAX_JOBS"]        = to_string(invocation.max_jobs);
+    if (invocation.concurrent && !invocation.analyze_includes
+            && concurrent_invocations(invocation).size() > 1) {
+        return build_concurrently(invocation);
     }
 
     auto project = buildhl::detect_project(invocation);
+
+    BuildStore store;
+    std::string job_count_line;
+    if (project != nullptr && !invocation.analyze_includes) {
+        if (!project->get_build_dir().empty())
+            store.open(project->get_build_dir());
+        load_program_cache(store);
+        JobCount job_count = decide_job_count(store, invocation.job_memory);
+        invocation.job_memory = job_count.job_memory;
+        if (invocation.max_jobs <= 0) {
+            invocation.max_jobs = job_count.jobs;
+            job_count_line = "[jobs] " + job_count.to_string();
+        }
+    }
+
+    export_invocation(invocation);
+
     InputStream_uptr input;
+    if (project != nullptr && invocation.analyze_includes) {
+        std::string build_dir = project->get_build_dir();
+        auto costs = analyze_includes(build_dir);
+        if (costs.empty()) {
+            std::cout << "no ninja dependency information found in " << build_dir << "\n";
+            return 1;
+        }
+        for (auto& line : include_report(costs)) {
+            std::cout << line << "\n";
+        }
+        return 0;
+    }
     if (project != nullptr) {
         project->set_invocation(invocation);
+        project->set_store(&store);
 
         bool signal_error = false;
         unblock_signals();
@@ -342,19 +990,35 @@ int main(int argc, char** argv_in) {
             stream_processor.set_base_dir(project->get_project_dir());
             stream_processor.add_search_path(project->get_build_dir());
             stream_processor.add_search_path(tea::getcwd());
+            stream_processor.set_monitor_interval(invocation.monitor_interval);
+            stream_processor.set_strip_input_colors(invocation.strip_input_colors);
+            stream_processor.report_line(job_count_line);
+            int configure_status = 0;
             if (project->should_configure()) {
                 input = project->configure(invocation.configure_options);
                 if (input != nullptr) {
                     block_signals();
                     stream_processor.process(*input);
+                    if (auto pinput = dynamic_cast<PopenInputStream*>(input.get()); pinput)
+                        configure_status = pinput->popen().wait();
+                    project->configured(configure_status);
                 }
             }
             unblock_signals();
-            input = project->make(invocation.target);
-            if (input != nullptr) {
-                block_signals();
-                stream_processor.process(*input);
+            // building a half generated build dir only adds confusing errors,
+            // the exit status is configure's
+            if (configure_status == 0) {
+                input = project->make(invocation.target);
+                if (input != nullptr) {
+                    block_signals();
+                    stream_processor.process(*input);
+                }
+            }
+            for (auto& line : project->build_report(stream_processor.usages())) {
+                stream_processor.report_line(line);
             }
+            learn_job_memory(store, stream_processor.usages());
+            save_program_cache(store);
         } catch (tea::SignalError& err) {
             signal_error = true;
             if (auto pinput = dynamic_cast<PopenInputStream*>(input.get()); pinput) {
@@ -4,4 +4,5 @@
 #include "subprocess/pipe.hpp"
 #include "subprocess/ProcessBuilder.hpp"
 #include "subprocess/shell_utils.hpp"
-#include "subprocess/environ.hpp"
\ No newline at end of file
+#include "subprocess/environ.hpp"
+#include "subprocess/EnvSnapshot.hpp"
\ No newline at end of file
@@ -1,34 +1,32 @@
+#pragma once
 /** @cond PRIVATE */
-#include <cstdint>
 #include <memory>
 
-// experemnting with this to reduce amount of copies for some APIs
+// reduces the amount of copies for some APIs
 namespace subprocess {
-    class RefCount {
-    public:
-        int release()   { return --mCount; }
-        int retain()    { return ++mCount; }
-        int refCount()  { return mCount; }
-    private:
-        int mCount=1;
-    };
-    class Data {
-    public:
-        typedef uint8_t byte;
+    /** Value shared between copies until one of them changes it.
 
-        void reserve(ssize_t size);
-    private:
-        byte*       mData       = nullptr;
-        ssize_t     mSize       = 0;
-        ssize_t     mCapacity   = 0;
-    };
+        Copying is a reference count increment. edit() copies the value
+        first if anyone else still shares it.
+    */
+    template <typename T>
     class CowData {
     public:
-        typedef uint8_t data_type;
-        void reserve(ssize_t size) { mData.resize(size); }
+        CowData() : mData(std::make_shared<T>()) {}
+        CowData(T value) : mData(std::make_shared<T>(std::move(value))) {}
 
+        const T& get() const { return *mData; }
+        const T* operator->() const { return mData.get(); }
+        /** @return the value for changing, not shared with any copy */
+        T& edit() {
+            if (mData.use_count() > 1)
+                mData = std::make_shared<T>(*mData);
+            return *mData;
+        }
+        /** both share the same value */
+        bool shares(const CowData& other) const { return mData == other.mData; }
     private:
-        std::shared_ptr<std::string> mData;
+        std::shared_ptr<T> mData;
     };
 }
-/** @endcond */
\ No newline at end of file
+/** @endcond */
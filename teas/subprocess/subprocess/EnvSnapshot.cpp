@@ -0,0 +1,176 @@
+#include "EnvSnapshot.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+
+#include "environ.hpp"
+
+#ifndef _WIN32
+extern "C" char **environ;
+#endif
+
+namespace subprocess {
+    struct EnvSnapshot::Block {
+        /** NAME=VALUE\0 of every variable */
+        std::string data;
+        /** pointers into data, nullptr at the end */
+        std::vector<char*> envp;
+        /** name to its index in envp, the first one if it's set twice */
+        std::unordered_map<std::string_view, size_t> slots;
+    };
+
+    struct EnvSnapshot::Envp {
+        // keep what the pointers point into alive
+        std::shared_ptr<const Block>    block;
+        CowData<Changes>                changes;
+        std::vector<char*>              envp;
+    };
+
+    std::shared_ptr<const EnvSnapshot::Block> EnvSnapshot::make_block(const std::vector<std::string_view>& lines) {
+        auto block = std::make_shared<Block>();
+        size_t size = 0;
+        for (std::string_view line : lines)
+            size += line.size() + 1;
+        block->data.reserve(size);
+        std::vector<size_t> offsets;
+        offsets.reserve(lines.size());
+        for (std::string_view line : lines) {
+            offsets.push_back(block->data.size());
+            block->data.append(line.data(), line.size());
+            block->data += '\0';
+        }
+        block->envp.reserve(offsets.size() + 1);
+        for (size_t offset : offsets) {
+            char* line = &block->data[offset];
+            size_t name_size = std::strcspn(line, "=");
+            block->slots.emplace(std::string_view(line, name_size), block->envp.size());
+            block->envp.push_back(line);
+        }
+        block->envp.push_back(nullptr);
+        return block;
+    }
+
+    namespace {
+        std::string_view value_of(std::string_view line, size_t name_size) {
+            return name_size < line.size()? line.substr(name_size + 1) : std::string_view();
+        }
+    }
+
+    EnvSnapshot::EnvSnapshot(const EnvMap& map) {
+        std::vector<std::string> lines;
+        lines.reserve(map.size());
+        for (auto& pair : map)
+            lines.push_back(pair.first + "=" + pair.second);
+        m_block = make_block(std::vector<std::string_view>(lines.begin(), lines.end()));
+    }
+
+    EnvSnapshot EnvSnapshot::current() {
+        EnvSnapshot result;
+#ifdef _WIN32
+        result = EnvSnapshot(current_env_copy());
+#else
+        static std::mutex mutex;
+        static std::shared_ptr<const Block> block;
+        std::unique_lock<std::mutex> lock(mutex);
+        size_t count = 0;
+        while (environ[count] != nullptr)
+            ++count;
+        // comparing is much cheaper than copying
+        bool same = block != nullptr && block->envp.size() == count + 1;
+        for (size_t i = 0; same && i < count; ++i)
+            same = std::strcmp(environ[i], block->envp[i]) == 0;
+        if (!same)
+            block = make_block(std::vector<std::string_view>(environ, environ + count));
+        result.m_block = block;
+#endif
+        return result;
+    }
+
+    bool EnvSnapshot::empty() const {
+        return m_block == nullptr && m_changes->empty();
+    }
+
+    std::string EnvSnapshot::get(const std::string& name) const {
+        auto change = m_changes->find(name);
+        if (change != m_changes->end())
+            return std::string(value_of(change->second.line, name.size()));
+        if (m_block == nullptr)
+            return {};
+        auto slot = m_block->slots.find(name);
+        if (slot == m_block->slots.end())
+            return {};
+        return std::string(value_of(m_block->envp[slot->second], name.size()));
+    }
+
+    bool EnvSnapshot::contains(const std::string& name) const {
+        auto change = m_changes->find(name);
+        if (change != m_changes->end())
+            return change->second.is_set;
+        return m_block != nullptr && m_block->slots.count(name) > 0;
+    }
+
+    EnvSnapshot& EnvSnapshot::set(const std::string& name, const std::string& value) {
+        // drop the envp first so it doesn't share the changes anymore
+        m_envp.reset();
+        Change& change = m_changes.edit()[name];
+        change.is_set   = true;
+        change.line     = name + "=" + value;
+        return *this;
+    }
+
+    EnvSnapshot& EnvSnapshot::unset(const std::string& name) {
+        m_envp.reset();
+        Change& change = m_changes.edit()[name];
+        change.is_set = false;
+        change.line.clear();
+        return *this;
+    }
+
+    char* const* EnvSnapshot::envp() const {
+        if (m_changes->empty() && m_block != nullptr)
+            return m_block->envp.data();
+        auto envp = std::atomic_load(&m_envp);
+        if (envp != nullptr)
+            return envp->envp.data();
+
+        auto built = std::make_shared<Envp>();
+        built->block    = m_block;
+        built->changes  = m_changes;
+        if (m_block != nullptr)
+            built->envp.assign(m_block->envp.begin(), m_block->envp.end() - 1);
+        bool removed = false;
+        for (auto& pair : built->changes.get()) {
+            const Change& change = pair.second;
+            char* line = change.is_set? const_cast<char*>(change.line.c_str()) : nullptr;
+            if (m_block != nullptr) {
+                auto slot = m_block->slots.find(pair.first);
+                if (slot != m_block->slots.end()) {
+                    built->envp[slot->second] = line;
+                    removed = removed || line == nullptr;
+                    continue;
+                }
+            }
+            if (line != nullptr)
+                built->envp.push_back(line);
+        }
+        if (removed)
+            built->envp.erase(std::remove(built->envp.begin(), built->envp.end(), nullptr), built->envp.end());
+        built->envp.push_back(nullptr);
+        std::atomic_store(&m_envp, std::shared_ptr<const Envp>(built));
+        return built->envp.data();
+    }
+
+    EnvMap EnvSnapshot::to_map() const {
+        EnvMap map;
+        for (char* const* line = envp(); *line != nullptr; ++line) {
+            std::string_view view(*line);
+            size_t name_size = view.find('=');
+            if (name_size == std::string_view::npos || name_size == 0)
+                continue;
+            map.emplace(std::string(view.substr(0, name_size)), std::string(view.substr(name_size + 1)));
+        }
+        return map;
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "basic_types.hpp"
+#include "CowData.hpp"
+
+namespace subprocess {
+    /** Environment variables for a new process that are cheap to copy and
+        change.
+
+        The variables are kept in one block shared by all copies, ready to
+        be handed to the OS. Changes go into a small overlay of the copy
+        they are made on. So a spawn with a few variables changed costs
+        O(changes), not a copy of the whole environment.
+
+        An empty snapshot means inheriting the environment of the process.
+    */
+    class EnvSnapshot {
+    public:
+        EnvSnapshot(){}
+        EnvSnapshot(const EnvMap& map);
+
+        /** The environment of the process right now.
+
+            Reuses the previous snapshot while the environment is unchanged.
+        */
+        static EnvSnapshot current();
+
+        bool empty() const;
+        /** @return the value, empty if not set */
+        std::string get(const std::string& name) const;
+        bool contains(const std::string& name) const;
+
+        /** Changes only this snapshot, copies made before keep the old value */
+        EnvSnapshot& set(const std::string& name, const std::string& value);
+        EnvSnapshot& unset(const std::string& name);
+
+        EnvMap to_map() const;
+        /** NAME=VALUE strings with a nullptr at the end, like environ.
+
+            Built on first use after a change, valid until this snapshot
+            changes or is destroyed.
+        */
+        char* const* envp() const;
+
+    private:
+        struct Block;
+        struct Envp;
+        struct Change {
+            /** false if the variable was unset */
+            bool        is_set = false;
+            /** NAME=VALUE */
+            std::string line;
+        };
+        typedef std::unordered_map<std::string, Change> Changes;
+
+        static std::shared_ptr<const Block> make_block(const std::vector<std::string_view>& lines);
+
+        std::shared_ptr<const Block>    m_block;
+        CowData<Changes>                m_changes;
+        /** envp() of block plus changes, null until asked for */
+        mutable std::shared_ptr<const Envp> m_envp;
+    };
+}
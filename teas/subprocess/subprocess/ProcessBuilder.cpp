@@ -1,7 +1,7 @@
 #include "ProcessBuilder.hpp"
 
 #ifdef _WIN32
-
+#include <psapi.h>
 #else
 #include <spawn.h>
 #ifdef __APPLE__
@@ -11,9 +11,18 @@
 #endif
 #include <errno.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 #endif
 
 #include <string.h>
+#include <algorithm>
+#include <atomic>
 #include <thread>
 #include <mutex>
 #include <chrono>
@@ -245,11 +254,15 @@ namespace subprocess {
 
         pid = other.pid;
         returncode = other.returncode;
+        usage = other.usage;
         args = std::move(other.args);
 
 #ifdef _WIN32
         process_info = other.process_info;
         other.process_info = {0};
+#else
+        pidfd = other.pidfd;
+        other.pidfd = -1;
 #endif
 
         other.cin = kBadPipeValue;
@@ -281,8 +294,14 @@ namespace subprocess {
             CloseHandle(process_info.hThread);
 #endif
         }
+#ifndef _WIN32
+        if (pidfd != -1)
+            ::close(pidfd);
+        pidfd = -1;
+#endif
         pid = 0;
         returncode = kBadReturnCode;
+        usage = {};
         args.clear();
     }
 #ifdef _WIN32
@@ -303,6 +322,28 @@ namespace subprocess {
         LocalFree(lpMsgBuf);
         return message;
     }
+    namespace {
+        double filetime_seconds(const FILETIME& time) {
+            ULARGE_INTEGER ticks;
+            ticks.LowPart   = time.dwLowDateTime;
+            ticks.HighPart  = time.dwHighDateTime;
+            // 100ns ticks
+            return ticks.QuadPart/1e7;
+        }
+        /** of the process alone, windows doesn't count its children */
+        ResourceUsage process_usage(HANDLE process) {
+            ResourceUsage usage;
+            FILETIME creation, exit, kernel, user;
+            if (GetProcessTimes(process, &creation, &exit, &kernel, &user)) {
+                usage.user_seconds      = filetime_seconds(user);
+                usage.system_seconds    = filetime_seconds(kernel);
+            }
+            PROCESS_MEMORY_COUNTERS counters = {0};
+            if (K32GetProcessMemoryInfo(process, &counters, sizeof(counters)))
+                usage.max_rss = counters.PeakWorkingSetSize;
+            return usage;
+        }
+    }
     bool Popen::poll() {
         if (returncode != kBadReturnCode)
             return true;
@@ -327,6 +368,7 @@ namespace subprocess {
             throw OSError("GetExitCodeProcess failed: " + std::to_string(error) + ":" + lastErrorString());
         }
         returncode = exit_code;
+        usage = process_usage(process_info.hProcess);
         return true;
     }
 
@@ -354,9 +396,14 @@ namespace subprocess {
             throw OSError("GetExitCodeProcess failed: " + std::to_string(error) + ":" + lastErrorString());
         }
         returncode = exit_code;
+        usage = process_usage(process_info.hProcess);
         return returncode;
     }
 
+    PipeHandle Popen::exit_handle() {
+        return process_info.hProcess;
+    }
+
     bool Popen::send_signal(int signum) {
         if (returncode != kBadReturnCode)
             return false;
@@ -372,22 +419,95 @@ namespace subprocess {
         return success;
     }
 #else
+    namespace {
+        /** a waiter on the shared SIGCHLD pipe may miss the wakeup another
+            waiter drained, so it checks again after this long.
+        */
+        constexpr double kSharedExitPollSeconds = 0.05;
+
+        int g_sigchld_pipe[2] = {-1, -1};
+        struct sigaction g_previous_sigchld;
+
+        void sigchld_handler(int signum, siginfo_t* info, void* context) {
+            int saved_errno = errno;
+            char byte = 0;
+            // if the pipe is full it is readable already
+            if (::write(g_sigchld_pipe[1], &byte, 1) < 0) {}
+            errno = saved_errno;
+            if (g_previous_sigchld.sa_flags & SA_SIGINFO) {
+                if (g_previous_sigchld.sa_sigaction != nullptr)
+                    g_previous_sigchld.sa_sigaction(signum, info, context);
+            } else if (g_previous_sigchld.sa_handler != SIG_DFL
+                    && g_previous_sigchld.sa_handler != SIG_IGN) {
+                g_previous_sigchld.sa_handler(signum);
+            }
+        }
+
+        /** read end of the self pipe SIGCHLD writes to, for kernels
+            without pidfd_open (< 5.3) and non linux.
+        */
+        int sigchld_pipe() {
+            static std::once_flag once;
+            std::call_once(once, []() {
+                if (::pipe(g_sigchld_pipe) != 0)
+                    throw OSError("pipe failed: " + std::string(strerror(errno)));
+                for (int fd : g_sigchld_pipe) {
+                    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                    fcntl(fd, F_SETFD, FD_CLOEXEC);
+                }
+                struct sigaction action;
+                memset(&action, 0, sizeof(action));
+                action.sa_sigaction = sigchld_handler;
+                action.sa_flags = SA_SIGINFO | SA_RESTART | SA_NOCLDSTOP;
+                sigemptyset(&action.sa_mask);
+                sigaction(SIGCHLD, &action, &g_previous_sigchld);
+            });
+            return g_sigchld_pipe[0];
+        }
+
+        int pidfd_open(pid_t pid) {
+#ifdef SYS_pidfd_open
+            static std::atomic<bool> unsupported{false};
+            if (!unsupported) {
+                int fd = syscall(SYS_pidfd_open, pid, 0);
+                if (fd >= 0)
+                    return fd;
+                if (errno == ENOSYS)
+                    unsupported = true;
+            }
+#endif
+            return -1;
+        }
+
+        void wait_readable(int fd, double timeout) {
+            struct pollfd poll_fd = {fd, POLLIN, 0};
+            int ms = std::max(1, (int)(timeout*1000.0));
+            if (::poll(&poll_fd, 1, ms) < 0 && errno != EINTR)
+                throw OSError("poll failed: " + std::string(strerror(errno)));
+        }
+    }
+
+    PipeHandle Popen::exit_handle() {
+        if (pidfd == -1 && pid != 0 && returncode == kBadReturnCode)
+            pidfd = pidfd_open(pid);
+        return pidfd != -1? pidfd : sigchld_pipe();
+    }
+
     bool Popen::poll() {
         if (returncode != kBadReturnCode)
             return true;
+        // drain before waitpid, a child exiting after it writes again
+        if (pidfd == -1 && g_sigchld_pipe[0] != -1) {
+            char buffer[64];
+            while (::read(g_sigchld_pipe[0], buffer, sizeof(buffer)) > 0) {}
+        }
         int exit_code;
-        auto child = waitpid(pid, &exit_code, WNOHANG);
+        struct rusage rusage = {};
+        auto child = wait4(pid, &exit_code, WNOHANG, &rusage);
         if (child == 0)
             return false;
-        if (child > 0) {
-            if(WIFEXITED(exit_code)) {
-                returncode = WEXITSTATUS(exit_code);
-            } else if (WIFSIGNALED(exit_code)) {
-                returncode = -WTERMSIG(exit_code);
-            } else {
-                returncode = 1;
-            }
-        }
+        if (child > 0)
+            set_exit_status(exit_code, rusage);
         return child > 0;
     }
     int Popen::wait(double timeout) {
@@ -395,8 +515,9 @@ namespace subprocess {
             return returncode;
         if (timeout < 0) {
             int exit_code;
+            struct rusage rusage = {};
             while (true) {
-                pid_t child = waitpid(pid, &exit_code,0);
+                pid_t child = wait4(pid, &exit_code, 0, &rusage);
                 if (child == -1 && errno == EINTR) {
                     continue;
                 }
@@ -405,23 +526,24 @@ namespace subprocess {
                 }
                 break;
             }
-            if(WIFEXITED(exit_code)) {
-                returncode = WEXITSTATUS(exit_code);
-            } else if (WIFSIGNALED(exit_code)) {
-                returncode = -WTERMSIG(exit_code);
-            } else {
-                returncode = 1;
-            }
+            set_exit_status(exit_code, rusage);
             return returncode;
         }
         StopWatch watch;
-
-        while (watch.seconds() < timeout) {
-            if (poll())
-                return returncode;
-            sleep_seconds(0.00001);
+        PipeHandle handle = exit_handle();
+        while (!poll()) {
+            double remaining = timeout - watch.seconds();
+            if (remaining <= 0) {
+                TimeoutExpired error("timeout of " + std::to_string(timeout) + " seconds expired");
+                error.command = args;
+                error.timeout = timeout;
+                throw error;
+            }
+            if (pidfd == -1)
+                remaining = std::min(remaining, kSharedExitPollSeconds);
+            wait_readable(handle, remaining);
         }
-        throw TimeoutExpired("no time");
+        return returncode;
     }
 
     bool Popen::send_signal(int signum) {
@@ -429,6 +551,26 @@ namespace subprocess {
             return false;
         return ::kill(pid, signum) == 0;
     }
+
+    void Popen::set_exit_status(int exit_code, const ::rusage& rusage) {
+        if(WIFEXITED(exit_code)) {
+            returncode = WEXITSTATUS(exit_code);
+        } else if (WIFSIGNALED(exit_code)) {
+            returncode = -WTERMSIG(exit_code);
+        } else {
+            returncode = 1;
+        }
+        usage.user_seconds      = rusage.ru_utime.tv_sec + rusage.ru_utime.tv_usec/1e6;
+        usage.system_seconds    = rusage.ru_stime.tv_sec + rusage.ru_stime.tv_usec/1e6;
+#ifdef __APPLE__
+        usage.max_rss           = rusage.ru_maxrss;
+#else
+        // kilobytes everywhere else
+        usage.max_rss           = (int64_t)rusage.ru_maxrss*1024;
+#endif
+        usage.voluntary_switches    = rusage.ru_nvcsw;
+        usage.involuntary_switches  = rusage.ru_nivcsw;
+    }
 #endif
     bool Popen::terminate() {
         return send_signal(PSIGTERM);
@@ -497,6 +639,7 @@ namespace subprocess {
 
         popen.wait();
         completed.returncode = popen.returncode;
+        completed.usage = popen.usage;
         completed.args = CommandLine(popen.args.begin()+1, popen.args.end());
         if (check) {
             CalledProcessError error("failed to execute " + popen.args[0]);
@@ -509,15 +652,61 @@ namespace subprocess {
         return completed;
     }
 
+    namespace {
+        /** Reads handle to the end like pipe_read_all(). Once stop is set
+            it only reads what is already there, a grandchild holding on to
+            the pipe can't keep it waiting.
+        */
+        std::string read_until_stopped(PipeHandle handle, const std::atomic<bool>& stop) {
+            std::string result;
+            char buffer[16*1024];
+            while (true) {
+#ifdef _WIN32
+                DWORD available = 0;
+                // fails once the pipe is closed
+                if (!PeekNamedPipe(handle, nullptr, 0, nullptr, &available, nullptr))
+                    break;
+                if (available == 0) {
+                    if (stop)
+                        break;
+                    sleep_seconds(0.01);
+                    continue;
+                }
+#else
+                struct pollfd fd = {handle, POLLIN, 0};
+                int count = ::poll(&fd, 1, stop? 0 : 50);
+                if (count < 0 && errno != EINTR)
+                    break;
+                if (count <= 0) {
+                    if (stop)
+                        break;
+                    continue;
+                }
+#endif
+                ssize_t transfered = pipe_read(handle, buffer, sizeof(buffer));
+                if (transfered <= 0)
+                    break;
+                result.append(buffer, transfered);
+            }
+            return result;
+        }
+    }
+
     CompletedProcess run(CommandLine command, RunOptions options) {
+        double timeout = options.timeout;
         Popen popen(command, std::move(options));
         CompletedProcess completed;
         std::thread cout_thread;
         std::thread cerr_thread;
+        // set once the child was killed for its timeout
+        std::atomic<bool> stop{false};
+        auto read_pipe = [&](PipeHandle handle) {
+            return timeout >= 0? read_until_stopped(handle, stop) : pipe_read_all(handle);
+        };
         if (popen.cout != kBadPipeValue) {
             cout_thread = std::thread([&]() {
                 try {
-                    completed.cout = pipe_read_all(popen.cout);
+                    completed.cout = read_pipe(popen.cout);
                 } catch (...) {
                 }
                 pipe_close(popen.cout);
@@ -527,7 +716,7 @@ namespace subprocess {
         if (popen.cerr != kBadPipeValue) {
             cerr_thread = std::thread([&]() {
                 try {
-                    completed.cerr = pipe_read_all(popen.cerr);
+                    completed.cerr = read_pipe(popen.cerr);
                 } catch (...) {
                 }
                 pipe_close(popen.cerr);
@@ -535,15 +724,34 @@ namespace subprocess {
             });
         }
 
-        if (cout_thread.joinable()) {
-            cout_thread.join();
-        }
-        if (cerr_thread.joinable()) {
-            cerr_thread.join();
+        auto join_threads = [&]() {
+            if (cout_thread.joinable()) {
+                cout_thread.join();
+            }
+            if (cerr_thread.joinable()) {
+                cerr_thread.join();
+            }
+        };
+        if (timeout >= 0) {
+            try {
+                popen.wait(timeout);
+            } catch (TimeoutExpired& error) {
+                popen.kill();
+                // what it started may still hold the pipes
+                stop = true;
+                join_threads();
+                popen.wait();
+                error.command   = command;
+                error.cout      = std::move(completed.cout);
+                error.cerr      = std::move(completed.cerr);
+                throw;
+            }
         }
+        join_threads();
 
         popen.wait();
         completed.returncode = popen.returncode;
+        completed.usage = popen.usage;
         completed.args = command;
         if (options.check && completed.returncode != 0) {
             CalledProcessError error("failed to execute " + command[0]);
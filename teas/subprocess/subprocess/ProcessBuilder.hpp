@@ -6,6 +6,11 @@
 
 #include "pipe.hpp"
 #include "PipeVar.hpp"
+#include "EnvSnapshot.hpp"
+
+#ifndef _WIN32
+struct rusage;
+#endif
 
 namespace subprocess {
 
@@ -51,11 +56,12 @@ namespace subprocess {
         /** current working directory for new process to use */
         std::string cwd;
         /** If empty inherits from current process */
-        EnvMap      env;
+        EnvSnapshot env;
 
-        /** Timeout in seconds. Raise TimeoutExpired.
+        /** Timeout in seconds. The process is killed and TimeoutExpired
+            raised once it expires.
 
-            Only available if you use subprocess_run
+            Only available if you use subprocess::run()
         */
         double timeout  = -1;
     };
@@ -98,6 +104,8 @@ namespace subprocess {
         pid_t       pid         = 0;
         /** The exit value of the process. Valid once process is completed */
         int         returncode  = kBadReturnCode;
+        /** Resources the process used. Valid once process is completed */
+        ResourceUsage usage;
         CommandLine args;
 
         /** calls pipe_ignore_and_close on cout */
@@ -120,13 +128,22 @@ namespace subprocess {
             deadlock. You can also troll the child by closing your end.
 
             @param timeout  timeout in seconds. Raises TimeoutExpired on
-                            timeout. NOT IMPLEMENTED, WILL WAIT FOREVER.
+                            timeout. Negative waits forever.
             @return returncode
 
             @throw OSError          If there was an os level error call OS API's
             @throw TimeoutExpired   If the timeout has expired.
         */
         int wait(double timeout=-1);
+        /** Handle that becomes readable once the process exits, to wait for
+            it together with pipes and timers in one poll() or
+            WaitForMultipleObjects(). This class holds the ownership.
+
+            On linux this is a pidfd. Where there is no pidfd_open it is a
+            pipe shared by all children that becomes readable whenever one
+            of them exits, call poll() to find out if it was this one.
+        */
+        PipeHandle exit_handle();
         /** Send the signal to the process.
 
             On windows SIGTERM is an alias for terminate()
@@ -152,6 +169,10 @@ namespace subprocess {
 
 #ifdef _WIN32
         PROCESS_INFORMATION process_info;
+#else
+        int pidfd = -1;
+        /** sets returncode and usage from what wait4 reported */
+        void set_exit_status(int status, const ::rusage& rusage);
 #endif
     };
 
@@ -177,7 +198,7 @@ namespace subprocess {
 
         bool new_process_group            = false;
         /** If empty inherits from current process */
-        EnvMap      env;
+        EnvSnapshot env;
         std::string cwd;
         CommandLine command;
 
@@ -245,7 +266,7 @@ namespace subprocess {
         /** Sets the current working directory to use for subprocess */
         RunBuilder& cwd(std::string cwd) {options.cwd = cwd; return *this;}
         /** Sets the environment to use. Default is current environment if unset */
-        RunBuilder& env(const EnvMap& env) {options.env = env; return *this;}
+        RunBuilder& env(const EnvSnapshot& env) {options.env = env; return *this;}
         /** Timeout to use for run() invocation only. */
         RunBuilder& timeout(double timeout) {options.timeout = timeout; return *this;}
         /** Set to true to run as new process group */
@@ -10,6 +10,20 @@
 
 extern "C" char **environ;
 
+/*  posix_spawn_file_actions_addchdir_np lets the child change directory
+    between fork and exec, so the parent's cwd is never touched. glibc has
+    it since 2.29, macOS since 10.15.
+*/
+#if defined(__GLIBC__) && defined(__GLIBC_PREREQ)
+#if __GLIBC_PREREQ(2, 29)
+#define SUBPROCESS_HAVE_ADDCHDIR 1
+#endif
+#elif defined(__APPLE__) && defined(__MAC_OS_X_VERSION_MIN_REQUIRED)
+#if __MAC_OS_X_VERSION_MIN_REQUIRED >= 101500
+#define SUBPROCESS_HAVE_ADDCHDIR 1
+#endif
+#endif
+
 using std::nullptr_t;
 
 using namespace subprocess::details;
@@ -75,6 +89,12 @@ namespace subprocess {
             int result = posix_spawn_file_actions_addclose(&actions, fd);
             throw_os_error("posix_spawn_file_actions_addclose", result);
         }
+#ifdef SUBPROCESS_HAVE_ADDCHDIR
+        void addchdir(const std::string& path) {
+            int result = posix_spawn_file_actions_addchdir_np(&actions, path.c_str());
+            throw_os_error("posix_spawn_file_actions_addchdir_np", result);
+        }
+#endif
 
         posix_spawn_file_actions_t* get() {return &actions;}
         posix_spawn_file_actions_t actions;
@@ -118,8 +138,8 @@ namespace subprocess {
 
         if (cout_option == PipeOption::close)
             actions.addclose(kStdOutValue);
-        else if (cout_option == PipeOption::pipe) {
-            cout_pair = pipe_create();
+        else if (cout_option == PipeOption::pipe || cout_option == PipeOption::pty) {
+            cout_pair = cout_option == PipeOption::pty? pipe_create_pty() : pipe_create();
             actions.addclose(cout_pair.input);
             actions.adddup2(cout_pair.output, kStdOutValue);
             actions.addclose(cout_pair.output);
@@ -137,8 +157,8 @@ namespace subprocess {
 
         if (cerr_option == PipeOption::close)
             actions.addclose(kStdErrValue);
-        else if (cerr_option == PipeOption::pipe) {
-            cerr_pair = pipe_create();
+        else if (cerr_option == PipeOption::pipe || cerr_option == PipeOption::pty) {
+            cerr_pair = cerr_option == PipeOption::pty? pipe_create_pty() : pipe_create();
             actions.addclose(cerr_pair.input);
             actions.adddup2(cerr_pair.output, kStdErrValue);
             actions.addclose(cerr_pair.output);
@@ -167,15 +187,8 @@ namespace subprocess {
         }
         args.push_back(nullptr);
         char** env = environ;
-        cstring_vector env_store;
-        if (!this->env.empty()) {
-            for (auto& pair : this->env) {
-                std::string line = pair.first + "=" + pair.second;
-                env_store.push_back(line);
-            }
-            env_store.push_back(nullptr);
-            env = &env_store[0];
-        }
+        if (!this->env.empty())
+            env = const_cast<char**>(this->env.envp());
 
         posix_spawnattr_t attributes;
         posix_spawnattr_init(&attributes);
@@ -206,11 +219,16 @@ namespace subprocess {
         flags |= POSIX_SPAWN_USEVFORK;
 #endif
         attributes_raii.setflags(flags);
+#ifdef SUBPROCESS_HAVE_ADDCHDIR
+        if (!this->cwd.empty())
+            actions.addchdir(this->cwd);
+        int ret = posix_spawn(&pid, args[0], actions.get(), &attributes, &args[0], env);
+        if(ret != 0)
+            throw SpawnError("posix_spawn failed with error: " + std::string(strerror(ret)));
+#else
         {
-            /*  I should have gone with vfork() :(
-                TODO: reimplement with vfork for thread safety.
-
-                this locking solution should work in practice just fine.
+            /*  No way to give the child its own cwd, so change ours while
+                spawning. Other threads see the wrong cwd meanwhile.
             */
             static std::mutex mutex;
             std::unique_lock<std::mutex> lock(mutex);
@@ -221,8 +239,8 @@ namespace subprocess {
             if(ret != 0)
                 throw SpawnError("posix_spawn failed with error: " + std::string(strerror(ret)));
         }
+#endif
         args.clear();
-        env_store.clear();
         if (cin_pair)
             cin_pair.close_input();
         if (cout_pair)
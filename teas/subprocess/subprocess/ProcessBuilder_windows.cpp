@@ -77,7 +77,7 @@ namespace subprocess {
             cout_pair = pipe_create();
             siStartInfo.hStdOutput = cout_pair.output;
             disable_inherit(cout_pair.input);
-        } else if (cout_option == PipeOption::pipe) {
+        } else if (cout_option == PipeOption::pipe || cout_option == PipeOption::pty) {
             cout_pair = pipe_create();
             siStartInfo.hStdOutput = cout_pair.output;
             process.cout = cout_pair.input;
@@ -93,7 +93,7 @@ namespace subprocess {
             cerr_pair = pipe_create();
             siStartInfo.hStdError = cerr_pair.output;
             disable_inherit(cerr_pair.input);
-        } else if (cerr_option == PipeOption::pipe) {
+        } else if (cerr_option == PipeOption::pipe || cerr_option == PipeOption::pty) {
             cerr_pair = pipe_create();
             siStartInfo.hStdError = cerr_pair.output;
             process.cerr = cerr_pair.input;
@@ -123,7 +123,7 @@ namespace subprocess {
                 This won't work as expected if somewhere there is a multibyte
                 utf-16 char (4-bytes total).
             */
-            envblock = create_env_block(this->env);
+            envblock = create_env_block(this->env.to_map());
             env = (void*)envblock.data();
         }
         DWORD process_flags = CREATE_UNICODE_ENVIRONMENT;
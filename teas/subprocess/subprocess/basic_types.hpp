@@ -5,6 +5,7 @@
 #include <unistd.h>
 #endif
 
+#include <cstdint>
 #include <map>
 #include <stdexcept>
 #include <string>
@@ -96,7 +97,12 @@ namespace subprocess {
         */
         specific,
         pipe,       ///< Redirects to a new handle created for you.
-        close       ///< Troll the child by providing a closed pipe.
+        close,      ///< Troll the child by providing a closed pipe.
+        /** Like pipe but the child writes to a pseudo terminal, so it
+            flushes every line and uses colors like it would on a terminal.
+            For cout and cerr, a pipe on windows.
+        */
+        pty
     };
 
     struct SubprocessError : std::runtime_error {
@@ -147,6 +153,26 @@ namespace subprocess {
         std::string cerr;
     };
 
+    /** Resources a process used, including its children it waited for.
+        Zero where the OS doesn't tell.
+    */
+    struct ResourceUsage {
+        /** CPU seconds spent in user mode */
+        double          user_seconds    = 0;
+        /** CPU seconds spent in the kernel */
+        double          system_seconds  = 0;
+        /** bytes resident of the largest single process, not the sum */
+        int64_t         max_rss         = 0;
+        /** switches waiting for IO or a lock */
+        int64_t         voluntary_switches      = 0;
+        /** switches because the time slice was used up or a higher priority
+            task took the CPU, many mean it was starved of CPUs.
+        */
+        int64_t         involuntary_switches    = 0;
+
+        double cpu_seconds() const { return user_seconds + system_seconds; }
+    };
+
     /** Details about a completed process. */
     struct CompletedProcess {
         /** The args used for the process. This includes the first first arg
@@ -159,6 +185,8 @@ namespace subprocess {
         std::string     cout;
         /** Captured stderr */
         std::string     cerr;
+        /** resources the process used */
+        ResourceUsage   usage;
         explicit operator bool() const {
             return returncode == 0;
         }
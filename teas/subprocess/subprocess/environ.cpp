@@ -30,9 +30,7 @@ namespace subprocess {
     }
 
     EnvironSetter &EnvironSetter::operator=(const char* str) {
-        if (mName == "PATH" || mName == "Path" || mName == "path") {
-            find_program_clear_cache();
-        }
+        // find_program's cache is keyed by PATH, no need to clear it
 #ifdef _WIN32
         // if it's empty windows deletes it.
         _putenv_s(mName.c_str(), str? str : "");
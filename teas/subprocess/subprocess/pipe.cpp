@@ -1,10 +1,21 @@
 #include "pipe.hpp"
 
+#include <algorithm>
 #include <thread>
+#include <mutex>
+#include <set>
 
 #ifndef _WIN32
 #include <fcntl.h>
 #include <cerrno>
+#include <cstring>
+#include <termios.h>
+#include <sys/ioctl.h>
+#endif
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 #endif
 
 using namespace subprocess::details;
@@ -61,6 +72,21 @@ namespace subprocess {
         }
         return {input, output};
     }
+    PipePair pipe_create_pty(bool inheritable) {
+        return pipe_create(inheritable);
+    }
+    WindowSize pipe_window_size(PipeHandle handle) {
+        WindowSize size;
+        CONSOLE_SCREEN_BUFFER_INFO info;
+        if (GetConsoleScreenBufferInfo(handle, &info)) {
+            size.columns    = info.srWindow.Right - info.srWindow.Left + 1;
+            size.rows       = info.srWindow.Bottom - info.srWindow.Top + 1;
+        }
+        return size;
+    }
+    bool pipe_set_window_size(PipeHandle pty, WindowSize size) {
+        return false;
+    }
     ssize_t pipe_read(PipeHandle handle, void* buffer, std::size_t size) {
         DWORD bread = 0;
         bool result = ReadFile(handle, buffer, size, &bread, nullptr);
@@ -112,6 +138,73 @@ namespace subprocess {
         return {fd[0], fd[1]};
     }
 
+    PipePair pipe_create_pty(bool inheritable) {
+        int master = posix_openpt(O_RDWR | O_NOCTTY);
+        if (master < 0)
+            throw_os_error("posix_openpt", errno);
+        // closes master if the rest fails
+        PipePair master_only(master, kBadPipeValue);
+        if (grantpt(master) != 0)
+            throw_os_error("grantpt", errno);
+        if (unlockpt(master) != 0)
+            throw_os_error("unlockpt", errno);
+        char name[128];
+#ifdef __linux__
+        int result = ptsname_r(master, name, sizeof(name));
+        if (result != 0)
+            throw_os_error("ptsname_r", result);
+#else
+        {
+            static std::mutex mutex;
+            std::unique_lock<std::mutex> lock(mutex);
+            const char* shared_name = ptsname(master);
+            if (shared_name == nullptr)
+                throw_os_error("ptsname", errno);
+            strncpy(name, shared_name, sizeof(name) - 1);
+            name[sizeof(name) - 1] = 0;
+        }
+#endif
+        int slave = ::open(name, O_RDWR | O_NOCTTY);
+        if (slave < 0)
+            throw_os_error("open", errno);
+        master_only.disown();
+        PipePair pair(master, slave);
+
+        // the output is read like from a pipe, no \r added
+        struct termios attributes;
+        if (tcgetattr(slave, &attributes) == 0) {
+            attributes.c_oflag &= ~ONLCR;
+            tcsetattr(slave, TCSANOW, &attributes);
+        }
+        for (PipeHandle ours : {kStdOutValue, kStdErrValue, kStdInValue}) {
+            WindowSize size = pipe_window_size(ours);
+            if (size.columns > 0) {
+                pipe_set_window_size(master, size);
+                break;
+            }
+        }
+        pipe_set_inheritable(master, inheritable);
+        pipe_set_inheritable(slave, inheritable);
+        return pair;
+    }
+
+    WindowSize pipe_window_size(PipeHandle handle) {
+        WindowSize size;
+        struct winsize window = {};
+        if (ioctl(handle, TIOCGWINSZ, &window) == 0) {
+            size.columns    = window.ws_col;
+            size.rows       = window.ws_row;
+        }
+        return size;
+    }
+
+    bool pipe_set_window_size(PipeHandle pty, WindowSize size) {
+        struct winsize window = {};
+        window.ws_col = size.columns;
+        window.ws_row = size.rows;
+        return ioctl(pty, TIOCSWINSZ, &window) == 0;
+    }
+
     ssize_t pipe_read(PipeHandle handle, void* buffer, size_t size) {
         return ::read(handle, buffer, size);
     }
@@ -121,34 +214,205 @@ namespace subprocess {
     }
 #endif
 
-    std::string pipe_read_all(PipeHandle handle) {
+    namespace {
+        /** @return bytes waiting in the pipe, 0 if unknown */
+        size_t pipe_available(PipeHandle handle) {
+#ifdef _WIN32
+            DWORD available = 0;
+            if (!PeekNamedPipe(handle, nullptr, 0, nullptr, &available, nullptr))
+                return 0;
+            return available;
+#else
+            int available = 0;
+            if (ioctl(handle, FIONREAD, &available) != 0 || available < 0)
+                return 0;
+            return available;
+#endif
+        }
+    }
+
+    std::string pipe_read_all(PipeHandle handle, size_t size_hint) {
         if (handle == kBadPipeValue)
             return {};
-        constexpr int buf_size = 2048;
-        uint8_t buf[buf_size];
+        constexpr size_t kMinRead = 16*1024;
         std::string result;
+        size_t size = 0;
+        // one more than the hint so the read that sees the end needs no growth
+        result.resize(size_hint > 0? size_hint + 1 : std::max(pipe_available(handle), kMinRead));
         while(true) {
-            ssize_t transfered = pipe_read(handle, buf, buf_size);
-            if(transfered > 0) {
-                result.insert(result.end(), &buf[0], &buf[transfered]);
-            } else {
+            if (size == result.size())
+                result.resize(std::max(result.size()*2, kMinRead));
+            ssize_t transfered = pipe_read(handle, &result[size], result.size() - size);
+            if (transfered <= 0)
                 break;
-            }
+            size += transfered;
         }
+        result.resize(size);
+        if (result.capacity() > 2*size + kMinRead)
+            result.shrink_to_fit();
         return result;
     }
 
+    int64_t pipe_splice_all(PipeHandle input, PipeHandle output) {
+        if (input == kBadPipeValue || output == kBadPipeValue)
+            return -1;
+        int64_t total = 0;
+#ifdef __linux__
+        constexpr size_t kSpliceSize = 1024*1024;
+        while (true) {
+            ssize_t transfered = splice(input, nullptr, output, nullptr, kSpliceSize, SPLICE_F_MOVE);
+            if (transfered > 0) {
+                total += transfered;
+                continue;
+            }
+            if (transfered == 0)
+                return total;
+            if (errno == EINTR)
+                continue;
+            // output not supported by splice, e.g. opened with O_APPEND
+            if (errno == EINVAL && total == 0)
+                break;
+            return -1;
+        }
+#endif
+        std::vector<uint8_t> buffer(64*1024);
+        while (true) {
+            ssize_t transfered = pipe_read(input, &buffer[0], buffer.size());
+            if (transfered == 0)
+                return total;
+            if (transfered < 0)
+                return -1;
+            for (ssize_t pos = 0; pos < transfered;) {
+                ssize_t written = pipe_write(output, &buffer[pos], transfered - pos);
+                if (written <= 0)
+                    return -1;
+                pos += written;
+            }
+            total += transfered;
+        }
+    }
+
+#ifdef __linux__
+    namespace {
+        /** One thread that reads and discards from every ignored pipe,
+            closing each at its end.
+        */
+        class DrainReactor {
+        public:
+            static DrainReactor& instance() {
+                // never destroyed, the thread is joined by shutdown() atexit
+                static DrainReactor* reactor = new DrainReactor();
+                return *reactor;
+            }
+
+            void add(PipeHandle handle) {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                if (m_stopped) {
+                    pipe_close(handle);
+                    return;
+                }
+                start_ifneeded();
+                fcntl(handle, F_SETFL, fcntl(handle, F_GETFL) | O_NONBLOCK);
+                struct epoll_event event = {};
+                event.events = EPOLLIN;
+                event.data.fd = handle;
+                if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, handle, &event) != 0) {
+                    // regular files can't be polled, nobody waits on them
+                    if (errno == EPERM) {
+                        pipe_close(handle);
+                        return;
+                    }
+                    throw_os_error("epoll_ctl", errno);
+                }
+                m_handles.insert(handle);
+            }
+
+            /** Stops the thread and closes the pipes still open. */
+            void shutdown() {
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    if (m_stopped || !m_thread.joinable()) {
+                        m_stopped = true;
+                        return;
+                    }
+                    m_stopped = true;
+                }
+                uint64_t one = 1;
+                if (::write(m_wake, &one, sizeof(one)) < 0) {}
+                m_thread.join();
+                for (PipeHandle handle : m_handles)
+                    pipe_close(handle);
+                m_handles.clear();
+                ::close(m_epoll);
+                ::close(m_wake);
+            }
+        private:
+            void start_ifneeded() {
+                if (m_thread.joinable())
+                    return;
+                m_epoll = epoll_create1(EPOLL_CLOEXEC);
+                if (m_epoll < 0)
+                    throw_os_error("epoll_create1", errno);
+                m_wake = eventfd(0, EFD_CLOEXEC);
+                if (m_wake < 0)
+                    throw_os_error("eventfd", errno);
+                struct epoll_event event = {};
+                event.events = EPOLLIN;
+                event.data.fd = m_wake;
+                epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wake, &event);
+                m_thread = std::thread([this]() { run(); });
+                std::atexit([]() { instance().shutdown(); });
+            }
+
+            void run() {
+                constexpr int kMaxEvents = 64;
+                struct epoll_event events[kMaxEvents];
+                std::vector<uint8_t> buffer(64*1024);
+                while (true) {
+                    int count = epoll_wait(m_epoll, events, kMaxEvents, -1);
+                    if (count < 0 && errno != EINTR)
+                        break;
+                    for (int i = 0; i < count; ++i) {
+                        PipeHandle handle = events[i].data.fd;
+                        if (handle == m_wake)
+                            return;
+                        ssize_t transfered = pipe_read(handle, &buffer[0], buffer.size());
+                        if (transfered > 0 || (transfered < 0 && errno == EAGAIN))
+                            continue;
+                        epoll_ctl(m_epoll, EPOLL_CTL_DEL, handle, nullptr);
+                        std::unique_lock<std::mutex> lock(m_mutex);
+                        m_handles.erase(handle);
+                        pipe_close(handle);
+                    }
+                }
+            }
+
+            std::mutex          m_mutex;
+            std::thread         m_thread;
+            int                 m_epoll     = -1;
+            int                 m_wake      = -1;
+            bool                m_stopped   = false;
+            std::set<PipeHandle> m_handles;
+        };
+    }
+
+    void pipe_ignore_and_close(PipeHandle handle) {
+        if (handle == kBadPipeValue)
+            return;
+        DrainReactor::instance().add(handle);
+    }
+#else
     void pipe_ignore_and_close(PipeHandle handle) {
         if (handle == kBadPipeValue)
             return;
         std::thread thread([handle]() {
             std::vector<uint8_t> buffer(1024);
-            while(pipe_read(handle, &buffer[0], buffer.size()) >= 0){
+            while(pipe_read(handle, &buffer[0], buffer.size()) > 0){
             }
             pipe_close(handle);
         });
         thread.detach();
     }
-
+#endif
 
 }
\ No newline at end of file
@@ -51,6 +51,36 @@ namespace subprocess {
         @return pipe pair. If failure returned pipes will have values of kBadPipeValue
     */
     PipePair pipe_create(bool inheritable = true);
+    /** Creates a pseudo terminal to give a child as its output.
+
+        input is the end to read from, output the terminal for the child.
+        It gets the window size of the terminal we write to, if any, and
+        doesn't turn "\n" into "\r\n". Reading input fails instead of
+        returning 0 once every handle to output is closed.
+
+        On windows it's a pipe.
+
+        @throw OSError if system call fails.
+    */
+    PipePair pipe_create_pty(bool inheritable = true);
+
+    /** Size of a terminal in characters */
+    struct WindowSize {
+        int columns = 0;
+        int rows    = 0;
+        bool operator==(const WindowSize& other) const {
+            return columns == other.columns && rows == other.rows;
+        }
+        bool operator!=(const WindowSize& other) const { return !(*this == other); }
+    };
+    /** @return size of the terminal handle refers to, 0x0 if it isn't one */
+    WindowSize pipe_window_size(PipeHandle handle);
+    /** Resizes the pseudo terminal from pipe_create_pty(), given either
+        end. Programs on it see the new size next time they ask for it.
+
+        @return false on failure, always on windows.
+    */
+    bool pipe_set_window_size(PipeHandle pty, WindowSize size);
     /** Set the pipe to be inheritable or not for subprocess.
 
         @throw OSError if system call fails.
@@ -69,16 +99,32 @@ namespace subprocess {
                     more data.
     */
     ssize_t pipe_write(PipeHandle, const void* buffer, size_t size);
-    /** Spawns a thread to read from the pipe. When no more data available
-        pipe will be closed.
+    /** Reads and discards the pipe until its end, then closes it.
+
+        On linux one thread drains all ignored pipes with epoll, it is
+        started with the first one and stopped at exit. Elsewhere each pipe
+        gets a thread.
     */
     void pipe_ignore_and_close(PipeHandle handle);
     /** Read contents of handle until no more data is available.
 
         If the pipe is non-blocking this will end prematurely.
 
+        The data is read straight into the string, which grows
+        geometrically from the size hint or what is waiting in the pipe.
+
+        @param size_hint    expected size of the data, 0 if unknown.
+
         @return all data read from pipe as a string object. This works fine
                 with binary data.
     */
-    std::string pipe_read_all(PipeHandle handle);
+    std::string pipe_read_all(PipeHandle handle, size_t size_hint=0);
+    /** Copy contents of input to output until no more data is available.
+
+        On linux this uses splice() so the data never passes through user
+        space, when output is a file or pipe it supports.
+
+        @return bytes copied, -1 on error.
+    */
+    int64_t pipe_splice_all(PipeHandle input, PipeHandle output);
 }
\ No newline at end of file
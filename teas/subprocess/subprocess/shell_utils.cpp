@@ -17,8 +17,10 @@
 
 #include <cctype>
 #include <stdlib.h>
+#include <limits>
 #include <map>
 #include <mutex>
+#include <shared_mutex>
 #include <filesystem>
 #include <iostream>
 #include <sstream>
@@ -172,107 +174,235 @@ namespace subprocess {
         return "";
     }
 
-    static std::mutex g_program_cache_mutex;
-    static std::map<std::string, std::string> g_program_cache;
+    namespace {
+        struct FoundProgram {
+            /** empty if not found */
+            std::string path;
+            /** index of the PATH dir it was found in, past the end if all of
+                them were searched. -1 if it wasn't looked up in PATH.
+            */
+            int dir = -1;
+        };
 
-    static std::string find_program_in_path(const std::string& name) {
-        // because of the cache variable is static we do this to be thread safe
-        std::unique_lock lock(g_program_cache_mutex);
+        /** find_program results, only valid for the PATH they were found with */
+        struct ProgramCache {
+            std::shared_mutex mutex;
+            uint64_t path_hash = 0;
+            /** modification times of the PATH dirs before they were searched */
+            std::vector<int64_t> dir_mtimes;
+            std::map<std::string, FoundProgram> programs;
 
-        std::map<std::string, std::string>& cache = g_program_cache;
-        if(name.empty())
-            return "";
-        if(name.size() >= 2) {
-            if((name[0] == '.' && name[1] == '/') || name[0] == '/') {
-                if(is_file(name)) {
-                    return abspath(name);
-                }
+            void reset(uint64_t hash, std::vector<int64_t> mtimes) {
+                path_hash   = hash;
+                dir_mtimes  = std::move(mtimes);
+                programs.clear();
             }
+        };
+        ProgramCache g_program_cache;
 
-            if(is_absolute_path(name) || (name[0] == '.' && name[1] == '/')) {
-                if(std::string test = try_exe(name); !test.empty()) {
-                    if(is_file(test)) {
-                        return abspath(test);
-                    }
-                }
+        uint64_t hash_path_env(const std::string& path_env) {
+            // FNV-1a, stable between runs unlike std::hash
+            uint64_t hash = 0xcbf29ce484222325ull;
+            for (unsigned char ch : path_env) {
+                hash ^= ch;
+                hash *= 0x100000001b3ull;
             }
+            return hash;
+        }
 
+        std::vector<int64_t> path_dir_mtimes(const std::string& path_env) {
+            std::vector<int64_t> result;
+            for (auto& dir : split(path_env, kPathDelimiter)) {
+                std::error_code ec;
+                auto mtime = std::filesystem::last_write_time(dir.empty()? "." : dir, ec);
+                result.push_back(ec? -1 : (int64_t)mtime.time_since_epoch().count());
+            }
+            return result;
         }
 
-        std::map<std::string, std::string>::iterator it = cache.find(name);
-        if(it != cache.end())
-            return it->second;
+        FoundProgram search_path(const std::string& path_env, const std::string& name) {
+            FoundProgram result;
+            result.dir = 0;
+            for(std::string test : split(path_env, kPathDelimiter)) {
+                if(!test.empty()) {
+                    test += '/';
+                    test += name;
+                    test = try_exe(test);
+                    if(!test.empty() && is_file(test)) {
+                        result.path = test;
+                        return result;
+                    }
+                }
+                ++result.dir;
+            }
+            return result;
+        }
 
-        std::string path_env = getenv("PATH");
-        for(std::string test : split(path_env, kPathDelimiter)) {
-            if(test.empty())
-                continue;
-            test += '/';
-            test += name;
-            test = try_exe(test);
-            if(!test.empty() && is_file(test)) {
-                cache[name] = test;
-                return test;
+        bool is_python3(std::string path) {
+            CompletedProcess process = subprocess::run({path, "--version"}, RunBuilder()
+                .cout(PipeOption::pipe)
+                .cerr(PipeOption::cout)
+            );
+            /*
+            CompletedProcess process = subprocess::RunBuilder({path, "--version"})
+                .cout(PipeOption::pipe)
+                .cerr(PipeOption::cout)
+                .run();
+            
+            
+            since c++20 we can do this
+            CompletedProcess process = subprocess::run({path, "--version"}, {
+                .cout = PipeOption::pipe,
+                .cerr = PipeOption::cout
+            });
+            */
+            for (size_t i = 0; i < process.cout.size()-1; ++i) {
+                char ch = process.cout[i];
+                if (ch >= '0' && ch <= '9') {
+                    if (ch == '3' && process.cout[i+1] == '.')
+                        return true;
+                    return false;
+                }
             }
+            return false;
         }
-        return "";
-    }
 
-    static bool is_python3(std::string path) {
-        CompletedProcess process = subprocess::run({path, "--version"}, RunBuilder()
-            .cout(PipeOption::pipe)
-            .cerr(PipeOption::cout)
-        );
-        /*
-        CompletedProcess process = subprocess::RunBuilder({path, "--version"})
-            .cout(PipeOption::pipe)
-            .cerr(PipeOption::cout)
-            .run();
-        
-        
-        since c++20 we can do this
-        CompletedProcess process = subprocess::run({path, "--version"}, {
-            .cout = PipeOption::pipe,
-            .cerr = PipeOption::cout
-        });
-        */
-        for (size_t i = 0; i < process.cout.size()-1; ++i) {
-            char ch = process.cout[i];
-            if (ch >= '0' && ch <= '9') {
-                if (ch == '3' && process.cout[i+1] == '.')
-                    return true;
-                return false;
+        /** python is python3 on some systems */
+        FoundProgram search_python3(const std::string& path_env) {
+            FoundProgram result;
+            for(std::string test : split(path_env, kPathDelimiter)) {
+                if(test.empty())
+                    continue;
+                test += '/';
+                test += "python";
+                test = try_exe(test);
+                if(!test.empty() && is_file(test)) {
+                    if (is_python3(test)) {
+                        result.path = test;
+                        break;
+                    }
+                }
             }
+            // a python3 added to any dir would be found first
+            result.dir = std::numeric_limits<int>::max();
+            return result;
         }
-        return false;
     }
+
     std::string find_program(const std::string& name) {
-        if (name != "python3") {
-            return find_program_in_path(name);
+        if(name.empty())
+            return "";
+        bool relative = name.size() >= 2 && name[0] == '.' && name[1] == '/';
+        if(relative) {
+            // depends on the cwd, not worth caching
+            if(is_file(name))
+                return abspath(name);
+            if(std::string test = try_exe(name); !test.empty() && is_file(test))
+                return abspath(test);
+            return "";
         }
-        std::string result = find_program_in_path(name);
-        if (!result.empty())
-            return result;
 
         std::string path_env = getenv("PATH");
-        for(std::string test : split(path_env, kPathDelimiter)) {
-            if(test.empty())
-                continue;
-            test += '/';
-            test += "python";
-            test = try_exe(test);
-            if(!test.empty() && is_file(test)) {
-                if (is_python3(test))
-                    return test;
-            }
+        uint64_t path_hash = hash_path_env(path_env);
+        ProgramCache& cache = g_program_cache;
+        bool new_path;
+        {
+            std::shared_lock lock(cache.mutex);
+            auto it = cache.programs.find(name);
+            if(cache.path_hash == path_hash && it != cache.programs.end())
+                return it->second.path;
+            new_path = cache.path_hash != path_hash;
         }
-        return "";
+        // taken before searching so changes while searching aren't missed
+        std::vector<int64_t> mtimes;
+        if (new_path)
+            mtimes = path_dir_mtimes(path_env);
+
+        FoundProgram found;
+        if(is_absolute_path(name)) {
+            if(is_file(name))
+                found.path = abspath(name);
+            else if(std::string test = try_exe(name); !test.empty() && is_file(test))
+                found.path = abspath(test);
+            // a stat is cheap, don't remember what is missing
+            if(found.path.empty())
+                return "";
+        } else {
+            found = search_path(path_env, name);
+            if(found.path.empty() && name == "python3")
+                found = search_python3(path_env);
+        }
+
+        std::unique_lock lock(cache.mutex);
+        if(cache.path_hash != path_hash)
+            cache.reset(path_hash, mtimes.empty()? path_dir_mtimes(path_env) : std::move(mtimes));
+        cache.programs[name] = found;
+        return found.path;
     }
 
     void find_program_clear_cache() {
-        std::unique_lock<std::mutex> lock(g_program_cache_mutex);
-        g_program_cache.clear();
+        std::unique_lock lock(g_program_cache.mutex);
+        g_program_cache.reset(0, {});
     }
+
+    std::string find_program_cache_save() {
+        std::shared_lock lock(g_program_cache.mutex);
+        const ProgramCache& cache = g_program_cache;
+        std::string programs;
+        for (auto& pair : cache.programs) {
+            if (pair.second.dir < 0)
+                continue;
+            programs += std::to_string(pair.second.dir) + "\t" + pair.first + "\t" + pair.second.path + "\n";
+        }
+        if (programs.empty())
+            return "";
+        std::string result = std::to_string(cache.path_hash) + " " + std::to_string(cache.dir_mtimes.size()) + "\n";
+        for (int64_t mtime : cache.dir_mtimes)
+            result += std::to_string(mtime) + "\n";
+        return result + programs;
+    }
+
+    void find_program_cache_load(const std::string& data) {
+        std::istringstream input(data);
+        uint64_t path_hash = 0;
+        size_t dir_count = 0;
+        if (!(input >> path_hash >> dir_count))
+            return;
+        std::string path_env = getenv("PATH");
+        if (path_hash != hash_path_env(path_env))
+            return;
+        std::vector<int64_t> saved(dir_count);
+        for (auto& mtime : saved)
+            input >> mtime;
+        input.get();
+
+        std::unique_lock lock(g_program_cache.mutex);
+        ProgramCache& cache = g_program_cache;
+        if (cache.path_hash != path_hash)
+            cache.reset(path_hash, path_dir_mtimes(path_env));
+        if (saved.size() != cache.dir_mtimes.size())
+            return;
+        // a program found in a dir is only shadowed by changes up to it
+        int changed = 0;
+        while (changed < (int)saved.size() && saved[changed] == cache.dir_mtimes[changed])
+            ++changed;
+        bool all_same = changed == (int)saved.size();
+
+        std::string line;
+        while (std::getline(input, line)) {
+            size_t name_pos = line.find('\t');
+            size_t path_pos = line.find('\t', name_pos + 1);
+            if (name_pos == std::string::npos || path_pos == std::string::npos)
+                continue;
+            FoundProgram found;
+            found.dir   = std::atoi(line.c_str());
+            found.path  = line.substr(path_pos + 1);
+            if (found.dir >= changed && !all_same)
+                continue;
+            cache.programs.emplace(line.substr(name_pos + 1, path_pos - name_pos - 1), found);
+        }
+    }
+
     std::string escape_shell_arg(std::string arg) {
         bool needs_quote = false;
         for(std::size_t i = 0; i < arg.size(); ++i) {
@@ -14,13 +14,25 @@ namespace subprocess {
     std::string find_program(const std::string& name);
     /** Clears cache used by find_program.
 
-        find_program uses internal cache to find executables. If you modify PATH
-        using subprocess::cenv this will be called automatically for you. If a
-        new program is added to a folder with the same name as an existing program
-        you may want to clear the cache so that the new program is found as
+        find_program uses internal cache to find executables, including the
+        ones it didn't find. The cache is only used with the PATH it was
+        filled with, so changing PATH in any way is safe. If a new program
+        is added to a folder with the same name as an existing program you
+        may want to clear the cache so that the new program is found as
         expected instead of the old program being returned.
     */
     void find_program_clear_cache();
+    /** @return what find_program found so far, for find_program_cache_load()
+                in a later run. Empty if nothing was looked up.
+    */
+    std::string find_program_cache_save();
+    /** Adds results of find_program_cache_save() to the cache.
+
+        They are only used if PATH is the same as when they were saved. A
+        result is dropped if a PATH directory it could be shadowed by was
+        modified since, programs that weren't found if any was.
+    */
+    void find_program_cache_load(const std::string& data);
     /** Escapes the argument suitable for use on command line. */
     std::string escape_shell_arg(std::string arg);
 
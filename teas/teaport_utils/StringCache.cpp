@@ -62,7 +62,7 @@ namespace tea {
         statement.bind_text(1, value);
         statement.bind_text(2, key);
 
-        if(statement.step() == SQLITE_ROW) {
+        if(statement.step() == SQLITE_DONE && mDb.changes() == 1) {
             return;
         }
 
@@ -18,6 +18,7 @@ extern "C" char **environ;
 #include <stdlib.h>
 #include <map>
 #include <mutex>
+#include <shared_mutex>
 
 #include "SafePrintf.hpp"
 #include "fileutils.hpp"
@@ -58,9 +59,9 @@ namespace tea {
     static std::string find_program_in_path(const std::string& name) {
         throw_signal_ifneeded();
         // because of the cache variable is static we do this to be thread safe
-        static std::mutex mutex;
-        std::unique_lock lock(mutex);
-
+        static std::shared_mutex mutex;
+        // only valid for the PATH it was filled with
+        static std::string cache_path;
         static std::map<std::string, std::string> cache;
         if(name.empty())
             return "";
@@ -81,22 +82,31 @@ namespace tea {
 
         }
 
-        std::map<std::string, std::string>::iterator it = cache.find(name);
-        if(it != cache.end())
-            return it->second;
-
         std::string path_env = getenv("PATH");
+        {
+            std::shared_lock lock(mutex);
+            auto it = cache.find(name);
+            if(cache_path == path_env && it != cache.end())
+                return it->second;
+        }
+        std::string result;
         for(std::string test : split(path_env, PATH_DELIMITER)) {
             if(test.empty())
                 continue;
             test = join_path(test, name);
             test = try_exe(test);
             if(!test.empty() && is_file(test)) {
-                cache[name] = test;
-                return test;
+                result = test;
+                break;
             }
         }
-        return "";
+        std::unique_lock lock(mutex);
+        if(cache_path != path_env) {
+            cache.clear();
+            cache_path = path_env;
+        }
+        cache[name] = result;
+        return result;
     }
 
     std::string find_program(const std::string& name) {
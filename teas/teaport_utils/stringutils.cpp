@@ -152,7 +152,7 @@ namespace tea {
     }
 
     std::string replace_string_variables(std::string input, const std::map<std::string, std::string>& vars) {
-        return replace_string_variables(input, [vars](const std::string& name) -> std::string {
+        return replace_string_variables(input, [&vars](const std::string& name) -> std::string {
             auto it = vars.find(name);
             if (it != vars.end())
                 return it->second;
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/** A few macros so the parsers can be checked against tables of real
+    input without pulling in a test framework.
+*/
+namespace buildhl_tests {
+    struct TestCase {
+        const char* name;
+        void (*function)();
+    };
+    std::vector<TestCase>& test_cases();
+    struct AddTest {
+        AddTest(const char* name, void (*function)()) {
+            test_cases().push_back({name, function});
+        }
+    };
+
+    void fail(const char* file, int line, const std::string& message);
+
+    /** str with control characters written as escapes, e.g. "\x1b[0m" */
+    std::string quoted(const std::string& str);
+    inline std::string printable(const std::string& value) { return quoted(value); }
+    inline std::string printable(const char* value) { return quoted(value); }
+    inline std::string printable(bool value) { return value? "true" : "false"; }
+    inline std::string printable(const std::vector<std::string>& strings) {
+        std::string result = "{";
+        for (auto& str : strings)
+            result += (result.size() > 1? ", " : "") + quoted(str);
+        return result + "}";
+    }
+    template<typename T>
+    std::string printable(const T& value) {
+        std::ostringstream out;
+        out << value;
+        return out.str();
+    }
+
+    template<typename A, typename B>
+    void check_equal(const A& actual, const B& expected, const char* expression,
+            const char* file, int line) {
+        if (actual == expected)
+            return;
+        fail(file, line, std::string(expression) + "\n    got      " + printable(actual)
+            + "\n    expected " + printable(expected));
+    }
+}
+
+#define TEST(name) \
+    static void test_##name(); \
+    static buildhl_tests::AddTest add_##name(#name, test_##name); \
+    static void test_##name()
+
+#define CHECK(condition) \
+    do { if (!(condition)) buildhl_tests::fail(__FILE__, __LINE__, #condition); } while (false)
+
+#define CHECK_EQ(actual, expected) \
+    buildhl_tests::check_equal((actual), (expected), #actual, __FILE__, __LINE__)
@@ -0,0 +1,51 @@
+#include "check.hpp"
+
+#include <cstdio>
+
+namespace buildhl_tests {
+    namespace {
+        int failures = 0;
+    }
+
+    std::vector<TestCase>& test_cases() {
+        static std::vector<TestCase> cases;
+        return cases;
+    }
+
+    void fail(const char* file, int line, const std::string& message) {
+        ++failures;
+        std::cerr << file << ":" << line << ": check failed: " << message << "\n";
+    }
+
+    std::string quoted(const std::string& str) {
+        std::string result = "\"";
+        for (unsigned char ch : str) {
+            if (ch == '\n') {
+                result += "\\n";
+            } else if (ch == '\r') {
+                result += "\\r";
+            } else if (ch == '"' || ch == '\\') {
+                result += '\\';
+                result += ch;
+            } else if (ch < 0x20 || ch == 0x7f) {
+                char hex[8];
+                snprintf(hex, sizeof(hex), "\\x%02x", ch);
+                result += hex;
+            } else {
+                result += ch;
+            }
+        }
+        return result + "\"";
+    }
+}
+
+int main() {
+    using namespace buildhl_tests;
+    for (auto& test : test_cases()) {
+        int before = failures;
+        test.function();
+        std::cout << (failures == before? "ok     " : "FAILED ") << test.name << "\n";
+    }
+    std::cout << test_cases().size() << " tests, " << failures << " failed checks\n";
+    return failures == 0? 0 : 1;
+}
@@ -0,0 +1,104 @@
+#include "check.hpp"
+
+#include <buildhl/FileFilter.hpp>
+#include <buildhl/ansi_escapes.hpp>
+
+using namespace buildhl;
+
+namespace {
+    /** what print_colored_line writes for line, paths filtered per run */
+    std::string rejoin(const std::string& line) {
+        FileFilter filter;
+        auto text = split_escapes(line);
+        return join_escapes(text.visible, text.escapes, [&](const std::string& run) {
+            return filter.filter(run);
+        });
+    }
+}
+
+TEST(split_escapes_clang_diagnostic) {
+    auto text = split_escapes("\x1b[1munused variable 'x'\x1b[0m\n");
+    CHECK_EQ(text.visible, "unused variable 'x'\n");
+    CHECK_EQ(text.escapes.size(), 2u);
+    CHECK_EQ(text.escapes[0].offset, 0u);
+    CHECK_EQ(text.escapes[0].sequence, "\x1b[1m");
+    CHECK(text.escapes[0].kind == Escape::Kind::color);
+    CHECK_EQ(text.escapes[1].offset, 19u);
+    CHECK_EQ(text.escapes[1].sequence, "\x1b[0m");
+}
+
+TEST(split_escapes_kinds) {
+    auto text = split_escapes("\x1b[01m\x1b[Ka\x1b(Bb\x1b]0;title\ac");
+    CHECK_EQ(text.visible, "abc");
+    CHECK_EQ(text.escapes.size(), 4u);
+    CHECK(text.escapes[0].kind == Escape::Kind::color);
+    CHECK(text.escapes[1].kind == Escape::Kind::other);
+    CHECK_EQ(text.escapes[2].sequence, "\x1b(B");
+    CHECK(text.escapes[2].kind == Escape::Kind::other);
+    CHECK_EQ(text.escapes[3].sequence, "\x1b]0;title\a");
+    CHECK(text.escapes[3].kind == Escape::Kind::other);
+}
+
+TEST(split_escapes_links) {
+    auto text = split_escapes("\x1b]8;;file:///src/a.cpp\x1b\\a.cpp\x1b]8;;\x1b\\:3\n");
+    CHECK_EQ(text.visible, "a.cpp:3\n");
+    CHECK_EQ(text.escapes.size(), 2u);
+    CHECK_EQ(text.escapes[0].sequence, "\x1b]8;;file:///src/a.cpp\x1b\\");
+    CHECK(text.escapes[0].kind == Escape::Kind::link);
+    CHECK_EQ(text.escapes[1].offset, 5u);
+    CHECK(text.escapes[1].kind == Escape::Kind::link);
+}
+
+TEST(split_escapes_truncated) {
+    CHECK_EQ(split_escapes("abc\x1b").visible, "abc");
+    CHECK_EQ(split_escapes("abc\x1b[").visible, "abc");
+    CHECK_EQ(split_escapes("abc\x1b[1;3").visible, "abc");
+    CHECK_EQ(split_escapes("abc\x1b[1;3").escapes.size(), 0u);
+    CHECK_EQ(split_escapes("abc\x1b]8;;http://x").visible, "abc");
+    CHECK_EQ(split_escapes("abc\x1b]8;;http://x\x1b").visible, "abc");
+    CHECK_EQ(split_escapes("abc\x1b(").visible, "abc");
+}
+
+TEST(shift_escapes_prefix) {
+    auto text = split_escapes("[1/2] \x1b[1mx\x1b[0m");
+    // "[1/2] " replaced by a 3 byte tag
+    shift_escapes(text.escapes, 6, 3);
+    CHECK_EQ(text.escapes[0].offset, 3u);
+    CHECK_EQ(text.escapes[1].offset, 4u);
+}
+
+TEST(join_escapes_keeps_delimiters) {
+    CHECK_EQ(rejoin("\x1b[1munused variable 'x'\x1b[0m\n"),
+        "\x1b[1munused variable 'x'\x1b[0m\n");
+    CHECK_EQ(rejoin("\x1b[01m\x1b[Ksrc/a.cpp:3:4:\x1b[m\x1b[K warning: x\n"),
+        "\x1b[01msrc/a.cpp:3:4:\x1b[m warning: x\n");
+    CHECK_EQ(rejoin("\x1b[1mwarning:\x1b[0m"), "\x1b[1mwarning:\x1b[0m");
+    CHECK_EQ(rejoin("\x1b[1mf(\x1b[0m\"a;b\"\x1b[1m;\x1b[0m"),
+        "\x1b[1mf(\x1b[0m\"a;b\"\x1b[1m;\x1b[0m");
+}
+
+TEST(file_filter_keeps_delimiters) {
+    FileFilter filter;
+    CHECK_EQ(filter.filter("warning:"), "warning:");
+    CHECK_EQ(filter.filter(":a::b:"), ":a::b:");
+    CHECK_EQ(filter.filter("'x'"), "'x'");
+    CHECK_EQ(filter.filter("f(a)(("), "f(a)((");
+}
+
+TEST(display_width) {
+    CHECK_EQ(display_width("abc"), 3u);
+    CHECK_EQ(display_width("\x1b[1;31mabc\x1b[0m"), 3u);
+    CHECK_EQ(display_width("\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e" "x"), 7u);
+    CHECK_EQ(display_width("e\xcc\x81"), 1u);
+    CHECK_EQ(display_width("\xf0\x9f\x98\x80"), 2u);
+    // invalid UTF-8 takes a column per byte
+    CHECK_EQ(display_width("\xe6\x97" "a"), 2u);
+}
+
+TEST(fit_width) {
+    CHECK_EQ(fit_width("abcdef", 3), "abc");
+    CHECK_EQ(fit_width("abc", 10), "abc");
+    CHECK_EQ(fit_width("\x1b[1mabcdef\x1b[0m", 3), "\x1b[1mabc\x1b[0m");
+    // a wide character isn't split
+    CHECK_EQ(fit_width("\xe6\x97\xa5\xe6\x9c\xac", 3), "\xe6\x97\xa5");
+}
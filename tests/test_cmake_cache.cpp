@@ -0,0 +1,74 @@
+#include "check.hpp"
+
+#include <buildhl/CMakeCacheView.hpp>
+
+#include <filesystem>
+#include <fstream>
+
+using namespace buildhl;
+namespace fs = std::filesystem;
+
+namespace {
+    std::string write_cache(const std::string& text) {
+        fs::path path = fs::temp_directory_path() / "buildhl_tests_CMakeCache.txt";
+        std::ofstream(path, std::ios::binary) << text;
+        return path.string();
+    }
+}
+
+TEST(cmake_cache_entries) {
+    std::string path = write_cache(
+        "# This is the CMakeCache file.\n"
+        "// Flags used by the CXX compiler\n"
+        "CMAKE_CXX_FLAGS:STRING=-O2 -DNAME=\"a;b\"\n"
+        "CMAKE_BUILD_TYPE:STRING=Debug\r\n"
+        "//ADVANCED property for variable: CMAKE_CXX_FLAGS\n"
+        "CMAKE_CXX_FLAGS-ADVANCED:INTERNAL=1\n"
+        "CMAKE_PROJECT_INCLUDE:FILEPATH=/src/cmake (old)/include.cmake\n"
+        "LIST:STRING=a;b)c;;\n"
+        "\"QUOTED:NAME=X\":PATH=/tmp\n"
+        "UNTYPED=value\n"
+        "EMPTY:STRING=\n"
+        "no equal sign\n"
+        "CMAKE_BUILD_TYPE:STRING=Release\n");
+    CMakeCacheView cache(path);
+    CHECK_EQ(cache.get("CMAKE_CXX_FLAGS"), "-O2 -DNAME=\"a;b\"");
+    CHECK_EQ(cache.type("CMAKE_CXX_FLAGS"), "STRING");
+    CHECK_EQ(cache.get("CMAKE_CXX_FLAGS-ADVANCED"), "1");
+    CHECK_EQ(cache.type("CMAKE_CXX_FLAGS-ADVANCED"), "INTERNAL");
+    CHECK_EQ(cache.get("CMAKE_PROJECT_INCLUDE"), "/src/cmake (old)/include.cmake");
+    CHECK_EQ(cache.get("LIST"), "a;b)c;;");
+    CHECK_EQ(cache.get("QUOTED:NAME=X"), "/tmp");
+    CHECK_EQ(cache.type("QUOTED:NAME=X"), "PATH");
+    CHECK_EQ(cache.get("UNTYPED"), "value");
+    CHECK_EQ(cache.type("UNTYPED"), "");
+    CHECK(cache.find("EMPTY") != nullptr);
+    CHECK_EQ(cache.get("EMPTY"), "");
+    CHECK(cache.find("no equal sign") == nullptr);
+    CHECK(cache.find("CMAKE_CXX") == nullptr);
+    // the last definition wins, CRLF or not
+    CHECK_EQ(cache.get("CMAKE_BUILD_TYPE"), "Release");
+    CHECK_EQ(cache.entries().size(), 8u);
+    for (size_t i = 1; i < cache.entries().size(); ++i)
+        CHECK(cache.entries()[i-1].name < cache.entries()[i].name);
+    fs::remove(path);
+}
+
+TEST(cmake_cache_reload) {
+    std::string path = write_cache("A:BOOL=ON\n");
+    CMakeCacheView cache(path);
+    CHECK_EQ(cache.get("A"), "ON");
+    CHECK(cache.reload_if_changed());
+    CHECK_EQ(cache.get("A"), "ON");
+
+    write_cache("A:BOOL=OFF\nB:STRING=x\n");
+    fs::last_write_time(path, fs::last_write_time(path) + std::chrono::seconds(2));
+    CHECK(cache.reload_if_changed());
+    CHECK_EQ(cache.get("A"), "OFF");
+    CHECK_EQ(cache.get("B"), "x");
+
+    fs::remove(path);
+    CHECK(!cache.reload_if_changed());
+    CHECK(cache.empty());
+    CHECK_EQ(cache.mtime(), 0);
+}
@@ -0,0 +1,174 @@
+#include "check.hpp"
+
+#include <buildhl/BuildStore.hpp>
+#include <buildhl/fingerprint.hpp>
+#include <buildhl/project_detect.hpp>
+
+#include <filesystem>
+#include <fstream>
+
+using namespace buildhl;
+namespace fs = std::filesystem;
+
+namespace {
+    /** a build dir with only CMakeFiles/Makefile.cmake */
+    std::string makefile_build_dir(const std::string& makefile) {
+        fs::path dir = fs::temp_directory_path() / "buildhl_tests_fingerprint";
+        fs::remove_all(dir);
+        fs::create_directories(dir / "CMakeFiles");
+        std::ofstream(dir / "CMakeFiles" / "Makefile.cmake") << makefile;
+        return dir.string();
+    }
+    typedef std::vector<std::string> Strings;
+
+    fs::path test_dir(const std::string& name) {
+        fs::path dir = fs::temp_directory_path() / name;
+        fs::remove_all(dir);
+        fs::create_directories(dir);
+        return dir;
+    }
+    void write_file(const fs::path& path, const std::string& text) {
+        std::ofstream(path, std::ios::binary) << text;
+    }
+}
+
+TEST(cmake_input_files_makefile) {
+    // as cmake writes it, with a ")" and an escaped quote in paths
+    std::string dir = makefile_build_dir(
+        "# CMAKE generated file: DO NOT EDIT!\n"
+        "set(CMAKE_DEPENDS_GENERATOR \"Unix Makefiles\")\n"
+        "\n"
+        "# The top level Makefile was generated from the following files:\n"
+        "set(CMAKE_MAKEFILE_DEPENDS\n"
+        "  \"CMakeCache.txt\"\n"
+        "  \"/src/lib (old)/CMakeLists.txt\"\n"
+        "  \"/src/say \\\"hi\\\";x/CMakeLists.txt\"\n"
+        "  \"/src/CMakeLists.txt\"\n"
+        "  )\n"
+        "\n"
+        "set(CMAKE_MAKEFILE_OUTPUTS\n"
+        "  \"Makefile\"\n"
+        "  )\n");
+    CHECK_EQ(cmake_input_files(dir), (Strings{
+        dir + "/CMakeCache.txt",
+        "/src/lib (old)/CMakeLists.txt",
+        "/src/say \"hi\";x/CMakeLists.txt",
+        "/src/CMakeLists.txt"}));
+    CHECK_EQ(cmake_output_files(dir), (Strings{dir + "/Makefile"}));
+    fs::remove_all(dir);
+}
+
+TEST(cmake_input_files_ninja) {
+    fs::path dir = fs::temp_directory_path() / "buildhl_tests_fingerprint";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    // escaped spaces and colons, a line continuation and order only inputs
+    std::ofstream(dir / "build.ninja") <<
+        "build all: phony app\n"
+        "\n"
+        "build build.ninja CMakeFiles/cmake.check$ cache: RERUN_CMAKE | /src/CMakeLists.txt $\n"
+        "    /src/my$ dir/CMakeLists.txt C$:/cost$$.cmake || order_only\n"
+        "  pool = console\n";
+    CHECK_EQ(cmake_input_files(dir.string()), (Strings{
+        "/src/CMakeLists.txt",
+        "/src/my dir/CMakeLists.txt",
+        (dir / "C:" / "cost$.cmake").string()}));
+    CHECK_EQ(cmake_output_files(dir.string()), (Strings{
+        (dir / "build.ninja").string(),
+        (dir / "CMakeFiles/cmake.check cache").string()}));
+    fs::remove_all(dir);
+}
+
+TEST(file_fingerprints) {
+    fs::path dir = test_dir("buildhl_tests_fingerprints");
+    Strings files = {(dir / "a.txt").string(), (dir / "b.txt").string()};
+    write_file(files[0], "hello");
+    write_file(files[1], "world");
+    auto mtime = fs::last_write_time(files[0]) - std::chrono::seconds(100);
+    fs::last_write_time(files[0], mtime);
+
+    FileFingerprints fingerprints;
+    uint64_t combined = fingerprints.update(files);
+    CHECK(fingerprints.dirty());
+    FileFingerprints loaded;
+    loaded.load(fingerprints.serialize());
+    CHECK_EQ(loaded.combined(), combined);
+    CHECK_EQ(loaded.update(files), combined);
+    CHECK(!loaded.dirty());
+
+    // same size and mtime isn't read again, even if the content differs
+    write_file(files[0], "HELLO");
+    fs::last_write_time(files[0], mtime);
+    CHECK_EQ(loaded.update(files), combined);
+    CHECK(!loaded.dirty());
+
+    // touched with the same content, the new mtime needs saving
+    write_file(files[0], "hello");
+    CHECK_EQ(loaded.update(files), combined);
+    CHECK(loaded.dirty());
+
+    write_file(files[0], "hello!");
+    CHECK(loaded.update(files) != combined);
+    fs::remove(files[0]);
+    uint64_t missing = loaded.update(files);
+    CHECK(missing != combined);
+    CHECK(loaded.update({files[1]}) != missing);
+    fs::remove_all(dir);
+}
+
+TEST(cmake_project_fingerprint) {
+    fs::path project = test_dir("buildhl_tests_fingerprint_project");
+    fs::path build = project / "build";
+    fs::create_directories(build / "CMakeFiles");
+    std::string lists = (project / "CMakeLists.txt").string();
+    write_file(lists, "project(p)\n");
+    write_file(build / "CMakeCache.txt",
+        "CMAKE_GENERATOR:INTERNAL=Unix Makefiles\n"
+        "CMAKE_HOME_DIRECTORY:INTERNAL=" + project.string() + "\n"
+        "CMAKE_PROJECT_NAME:STATIC=p\n");
+    write_file(build / "CMakeFiles" / "Makefile.cmake",
+        "set(CMAKE_MAKEFILE_DEPENDS\n"
+        "  \"" + lists + "\"\n"
+        "  )\n"
+        "set(CMAKE_MAKEFILE_OUTPUTS\n"
+        "  \"Makefile\"\n"
+        "  )\n");
+    write_file(build / "Makefile", "all:\n");
+    auto past = fs::file_time_type::clock::now() - std::chrono::seconds(100);
+    fs::last_write_time(lists, past);
+    fs::last_write_time(build / "Makefile", past);
+
+    {
+        BuildStore store;
+        CHECK(store.open(build.string()));
+        CMakeProject cmake_project(project.string(), build.string());
+        cmake_project.set_invocation(InvocationInfo());
+        cmake_project.set_store(&store);
+        // configured without us, or by a configure that failed
+        CHECK(cmake_project.should_configure());
+        cmake_project.configured(1);
+        CHECK(cmake_project.should_configure());
+        cmake_project.configured(0);
+        CHECK(!cmake_project.should_configure());
+
+        // touched, make would run cmake unless its outputs are newer again
+        write_file(lists, "project(p)\n");
+        fs::last_write_time(lists, past + std::chrono::seconds(50));
+        CHECK(!cmake_project.should_configure());
+        CHECK(fs::last_write_time(build / "Makefile") > fs::last_write_time(lists));
+
+        // the fingerprint comes back from the store of the build dir
+        {
+            BuildStore reopened;
+            CHECK(reopened.open(build.string()));
+            CMakeProject again(project.string(), build.string());
+            again.set_invocation(InvocationInfo());
+            again.set_store(&reopened);
+            CHECK(!again.should_configure());
+            write_file(lists, "project(p CXX)\n");
+            CHECK(again.should_configure());
+        }
+        CHECK(cmake_project.should_configure());
+    }
+    fs::remove_all(project);
+}
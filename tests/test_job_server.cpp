@@ -0,0 +1,95 @@
+#include "check.hpp"
+
+#include <buildhl/JobServer.hpp>
+#include <buildhl/system_info.hpp>
+
+#include <atomic>
+#include <filesystem>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+using namespace buildhl;
+namespace fs = std::filesystem;
+
+namespace {
+    constexpr int64_t kGiB = 1024*1024*1024ll;
+
+    JobServer::Sample sample(int64_t available, double load=-1, int cpus=8) {
+        JobServer::Sample result;
+        result.available_memory = available;
+        result.load             = load;
+        result.cpus             = cpus;
+        return result;
+    }
+}
+
+TEST(job_server_idle_allowed) {
+    // a token waits for every job the memory is there for
+    CHECK_EQ(JobServer::idle_allowed(8, kGiB, 0, sample(3*kGiB + kGiB/2)), 3);
+    CHECK_EQ(JobServer::idle_allowed(8, kGiB, 0, sample(kGiB/2)), 0);
+    // ones that just started will still take theirs
+    CHECK_EQ(JobServer::idle_allowed(8, kGiB, 2, sample(3*kGiB)), 1);
+    CHECK_EQ(JobServer::idle_allowed(8, kGiB, 5, sample(3*kGiB)), 0);
+    // unknown memory doesn't hold anything back
+    CHECK_EQ(JobServer::idle_allowed(8, kGiB, 0, sample(-1)), 8);
+    // load far above the CPUs, or our jobs when there are more of them
+    CHECK_EQ(JobServer::idle_allowed(8, kGiB, 0, sample(64*kGiB, 13, 8)), 0);
+    CHECK_EQ(JobServer::idle_allowed(8, kGiB, 0, sample(64*kGiB, 11, 8)), 64);
+    CHECK_EQ(JobServer::idle_allowed(16, kGiB, 0, sample(64*kGiB, 20, 8)), 64);
+    CHECK_EQ(JobServer::idle_allowed(8, kGiB, 0, sample(-1, 13, 8)), 0);
+}
+
+TEST(available_memory) {
+    std::string meminfo =
+        "MemTotal:       16384000 kB\n"
+        "MemFree:         1024000 kB\n"
+        "MemAvailable:    8192000 kB\n";
+    CHECK_EQ(available_memory(meminfo, -1, -1), 8192000*1024ll);
+    // the cgroup's limit is nearer
+    CHECK_EQ(available_memory(meminfo, 4*kGiB, 3*kGiB), kGiB);
+    CHECK_EQ(available_memory(meminfo, 64*kGiB, kGiB), 8192000*1024ll);
+    CHECK_EQ(available_memory(meminfo, kGiB, 2*kGiB), 0);
+    CHECK_EQ(available_memory("", 4*kGiB, kGiB), 3*kGiB);
+    CHECK_EQ(available_memory("", -1, -1), -1);
+}
+
+#ifndef _WIN32
+TEST(job_server_tokens) {
+    fs::path dir = fs::temp_directory_path() / "buildhl_tests_jobserver";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    std::atomic<int64_t> available{kGiB + kGiB/2};
+    JobServer server(4, kGiB);
+    server.set_sampler([&]() { return sample(available); });
+    CHECK(server.start((dir / "fifo").string()));
+
+    // memory for one more job than the one with the implicit token
+    int fd = ::open((dir / "fifo").c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    int waiting = -1;
+    CHECK(ioctl(fd, FIONREAD, &waiting) == 0);
+    CHECK_EQ(waiting, 1);
+    CHECK_EQ(server.min_allowed(), 2);
+    CHECK(!server.summary().empty());
+
+    // only make gets the descriptor of the pipe protocol
+    std::string flags = server.makeflags(false);
+    int client = std::stoi(flags.substr(flags.find('=') + 1));
+    CHECK(fcntl(client, F_GETFD) & FD_CLOEXEC);
+    {
+        JobServer::InheritClient inherit(&server);
+        JobServer::InheritClient nested(&server);
+        CHECK(!(fcntl(client, F_GETFD) & FD_CLOEXEC));
+    }
+    CHECK(fcntl(client, F_GETFD) & FD_CLOEXEC);
+    CHECK_EQ(server.makeflags(true), "-j4 --jobserver-auth=fifo:" + (dir / "fifo").string());
+
+    ::close(fd);
+    server.stop();
+    CHECK(!fs::exists(dir / "fifo"));
+    fs::remove_all(dir);
+}
+#endif
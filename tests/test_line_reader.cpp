@@ -0,0 +1,131 @@
+#include "check.hpp"
+
+#include <buildhl/LineReader.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace buildhl;
+
+namespace {
+    /** returns the chunks one read each, a chunk larger than the read
+        continues in the next one
+    */
+    struct ChunkStream : InputStream {
+        ChunkStream(std::vector<std::string> chunks) : chunks(std::move(chunks)) {}
+        ssize_t read(void* buffer, size_t size) override {
+            if (index >= chunks.size())
+                return 0;
+            std::string& chunk = chunks[index];
+            size_t count = std::min(size, chunk.size());
+            memcpy(buffer, chunk.data(), count);
+            chunk.erase(0, count);
+            if (chunk.empty())
+                ++index;
+            ++reads;
+            return count;
+        }
+        std::vector<std::string> chunks;
+        size_t index = 0;
+        int reads = 0;
+    };
+
+    const char* kind_name(LineReader::Kind kind) {
+        switch (kind) {
+        case LineReader::Kind::line:        return "line";
+        case LineReader::Kind::overwritten: return "overwritten";
+        case LineReader::Kind::partial:     return "partial";
+        case LineReader::Kind::end:         return "end";
+        }
+        return "?";
+    }
+
+    /** every next() as "kind text" until the end */
+    std::vector<std::string> read_all(std::vector<std::string> chunks, bool wait=true) {
+        ChunkStream input(std::move(chunks));
+        LineReader reader(input);
+        std::vector<std::string> result;
+        std::string text;
+        while (true) {
+            auto kind = reader.next(text, wait);
+            if (kind == LineReader::Kind::end)
+                break;
+            result.push_back(std::string(kind_name(kind)) + " " + text);
+        }
+        return result;
+    }
+    typedef std::vector<std::string> Strings;
+}
+
+TEST(line_reader_lines) {
+    CHECK_EQ(read_all({"a\nb\n"}), (Strings{"line a\n", "line b\n"}));
+    CHECK_EQ(read_all({"a\nb"}), (Strings{"line a\n", "line b"}));
+    CHECK_EQ(read_all({"a", "b\n", "\n"}), (Strings{"line ab\n", "line \n"}));
+    CHECK_EQ(read_all({}), Strings{});
+}
+
+TEST(line_reader_crlf) {
+    CHECK_EQ(read_all({"a\r\nb\r\n"}), (Strings{"line a\n", "line b\n"}));
+    CHECK_EQ(read_all({"\r\n"}), (Strings{"line \n"}));
+    // split between reads
+    CHECK_EQ(read_all({"a\r", "\nb\r\n"}), (Strings{"line a\n", "line b\n"}));
+    // split between 16 KiB blocks
+    std::string big(16*1024 - 1, 'x');
+    CHECK_EQ(read_all({big + "\r\nb\n"}), (Strings{"line " + big + "\n", "line b\n"}));
+    CHECK_EQ(read_all({big + "\rb\n"}), (Strings{"overwritten " + big, "line b\n"}));
+}
+
+TEST(line_reader_overwritten) {
+    CHECK_EQ(read_all({"1%\r2%\r3%\ndone\n"}),
+        (Strings{"overwritten 1%", "overwritten 2%", "line 3%\n", "line done\n"}));
+    // ninja's smart terminal status
+    CHECK_EQ(read_all({"\r[1/2] a\x1b[K\r[2/2] b\x1b[K\n"}),
+        (Strings{"overwritten [1/2] a\x1b[K", "line [2/2] b\x1b[K\n"}));
+    // the last status at the end of the input stays on the terminal
+    CHECK_EQ(read_all({"1%\r2%\r"}), (Strings{"overwritten 1%", "line 2%\n"}));
+    CHECK_EQ(read_all({"a\n\r"}), (Strings{"line a\n"}));
+}
+
+TEST(line_reader_no_wait) {
+    // each call reads once at most, as after a poll, and returns what the
+    // tool wrote so far instead of reading on
+    ChunkStream input({"\r[1/2] a\x1b[K", "\r[2/2] b\x1b[K", "\n"});
+    LineReader reader(input);
+    std::string text;
+    CHECK(!reader.buffered());
+    CHECK_EQ(kind_name(reader.next(text, false)), std::string("partial"));
+    CHECK_EQ(text, "[1/2] a\x1b[K");
+    CHECK_EQ(input.reads, 1);
+    CHECK(!reader.buffered());
+    CHECK_EQ(kind_name(reader.next(text, false)), std::string("overwritten"));
+    CHECK_EQ(text, "[1/2] a\x1b[K");
+    CHECK_EQ(input.reads, 2);
+    // the next status came with the same read
+    CHECK(reader.buffered());
+    CHECK_EQ(kind_name(reader.next(text, false)), std::string("partial"));
+    CHECK_EQ(text, "[2/2] b\x1b[K");
+    CHECK_EQ(input.reads, 2);
+    CHECK_EQ(kind_name(reader.next(text, false)), std::string("line"));
+    CHECK_EQ(text, "[2/2] b\x1b[K\n");
+    CHECK_EQ(kind_name(reader.next(text, false)), std::string("end"));
+
+    // a "\r" at the end isn't known to be a "\r\n" yet
+    CHECK_EQ(read_all({"a\r", "\n"}, false), (Strings{"partial a", "line a\n"}));
+}
+
+TEST(line_reader_end_input) {
+    // the tool exited, something it started holds the pipe
+    ChunkStream input({"a\nstatus\r", "never read"});
+    LineReader reader(input);
+    std::string text;
+    CHECK_EQ(kind_name(reader.next(text, false)), std::string("line"));
+    CHECK_EQ(kind_name(reader.next(text, false)), std::string("partial"));
+    CHECK_EQ(text, "status");
+    CHECK(!reader.buffered());
+    reader.end_input();
+    CHECK(reader.buffered());
+    CHECK_EQ(kind_name(reader.next(text, false)), std::string("line"));
+    CHECK_EQ(text, "status\n");
+    CHECK_EQ(kind_name(reader.next(text, false)), std::string("end"));
+    CHECK_EQ(input.reads, 1);
+}
@@ -0,0 +1,158 @@
+#include "check.hpp"
+
+#include <buildhl/ninja_files.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+using namespace buildhl;
+namespace fs = std::filesystem;
+
+namespace {
+    std::string test_build_dir() {
+        fs::path dir = fs::temp_directory_path() / "buildhl_tests_ninja";
+        fs::remove_all(dir);
+        fs::create_directories(dir);
+        return dir.string();
+    }
+
+    /** writes .ninja_deps records the way ninja's DepsLog does */
+    struct DepsLogWriter {
+        std::string data;
+
+        explicit DepsLogWriter(uint32_t version=4) {
+            data = "# ninjadeps\n";
+            u32(version);
+        }
+        void u32(uint32_t value) { data.append(reinterpret_cast<const char*>(&value), 4); }
+        void path(const std::string& path, int id) {
+            size_t padding = (4 - path.size() % 4) % 4;
+            u32(path.size() + padding + 4);
+            data += path;
+            data.append(padding, '\0');
+            u32(~(uint32_t)id);
+        }
+        void deps(int output, std::vector<int> inputs) {
+            u32(0x80000000u | (4 + 8 + 4*inputs.size()));
+            u32(output);
+            u32(1234);
+            u32(0);
+            for (int input : inputs)
+                u32(input);
+        }
+        void save(const std::string& build_dir) {
+            std::ofstream(build_dir + "/.ninja_deps", std::ios::binary) << data;
+        }
+    };
+
+    /** "output: input input" of every record */
+    std::vector<std::string> deps_of(const NinjaDeps& deps) {
+        std::vector<std::string> result;
+        for (auto& record : deps.records()) {
+            std::string line = std::string(deps.paths()[record.output]) + ":";
+            for (int i = 0; i < record.count; ++i)
+                line += " " + std::string(deps.paths()[record.inputs[i]]);
+            result.push_back(line);
+        }
+        return result;
+    }
+    typedef std::vector<std::string> Strings;
+}
+
+TEST(ninja_deps_v4) {
+    std::string dir = test_build_dir();
+    DepsLogWriter log;
+    // paths are written raw, ninja's $ escapes are only in build.ninja
+    log.path("CMakeFiles/a.dir/a.cpp.o", 0);
+    log.path("../src/a.cpp", 1);
+    log.path("../src/my dir/$a.hpp", 2);
+    log.path("/usr/include/stdio.h", 3);
+    log.deps(0, {1, 3});
+    log.path("b.o", 4);
+    log.deps(4, {2});
+    // a rebuild of a.cpp.o, only the newest counts
+    log.deps(0, {1, 2, 3});
+    log.save(dir);
+
+    NinjaDeps deps;
+    CHECK(deps.load(dir, "no-such-ninja"));
+    CHECK_EQ(deps.paths().size(), 5u);
+    CHECK_EQ(deps_of(deps), (Strings{
+        "CMakeFiles/a.dir/a.cpp.o: ../src/a.cpp ../src/my dir/$a.hpp /usr/include/stdio.h",
+        "b.o: ../src/my dir/$a.hpp"}));
+    fs::remove_all(dir);
+}
+
+TEST(ninja_deps_damaged) {
+    std::string dir = test_build_dir();
+    DepsLogWriter log;
+    log.path("a.o", 0);
+    log.path("a.c", 1);
+    log.deps(0, {1});
+    log.path("b.o", 2);
+    // an input that has no path, the record is dropped
+    log.deps(2, {1, 7});
+    log.save(dir);
+    // cut off in the middle of a record, like a build that was killed
+    std::string full = log.data;
+    log.path("c.o", 3);
+    log.deps(3, {1});
+    log.data.resize(log.data.size() - 6);
+    log.save(dir);
+
+    NinjaDeps deps;
+    CHECK(deps.load(dir, "no-such-ninja"));
+    CHECK_EQ(deps_of(deps), (Strings{"a.o: a.c"}));
+
+    // a path whose checksum isn't its id ends the log
+    log.data = full;
+    log.path("d.o", 9);
+    log.save(dir);
+    NinjaDeps checked;
+    CHECK(checked.load(dir, "no-such-ninja"));
+    CHECK_EQ(checked.paths().size(), 3u);
+
+    // other versions need ninja -t deps
+    DepsLogWriter v3(3);
+    v3.path("a.o", 0);
+    v3.save(dir);
+    NinjaDeps old;
+    CHECK(!old.load(dir, "no-such-ninja"));
+    fs::remove_all(dir);
+}
+
+TEST(ninja_link_outputs) {
+    std::string dir = test_build_dir();
+    std::ofstream(dir + "/build.ninja") <<
+        "ninja_required_version = 1.5\n"
+        "include rules$ dir/rules.ninja\n"
+        "build CMakeFiles/app.dir/main.cpp.o: CXX_COMPILER__app_Release /src/main.cpp\n"
+        "build my$ app$:1: CXX_EXECUTABLE_LINKER__app_Release CMakeFiles/app.dir/main.cpp.o\n"
+        "build libs.a: CXX_STATIC_LIBRARY_LINKER__s_Release s.o\n"
+        "build libd.so | libd.so.1: CXX_SHARED_LIBRARY_LINKER__d_Release d.o\n";
+    fs::create_directories(dir + "/rules dir");
+    std::ofstream(dir + "/rules dir/rules.ninja") <<
+        "build tool: C_EXECUTABLE_LINKER__tool_Release tool.o\n";
+    CHECK_EQ(ninja_link_outputs(dir), (Strings{"tool", "my app:1", "libd.so"}));
+    fs::remove_all(dir);
+}
+
+TEST(ninja_log) {
+    std::string dir = test_build_dir();
+    std::ofstream(dir + "/.ninja_log") <<
+        "# ninja log v5\n"
+        "0\t120\t1700000000\ta.o\tdeadbeef\n"
+        "5\t300\t1700000000\tb.o\tdeadbeef\n"
+        "bad line\n"
+        "310\t400\t1700000001\ta.o\tcafe\n";
+    auto entries = load_ninja_log(dir);
+    CHECK_EQ(entries.size(), 2u);
+    if (entries.size() == 2) {
+        CHECK_EQ(entries[0].output, "b.o");
+        CHECK_EQ(entries[1].output, "a.o");
+        CHECK_EQ(entries[1].seconds(), 0.09);
+    }
+    fs::remove_all(dir);
+}
@@ -0,0 +1,56 @@
+#include "check.hpp"
+
+#include <buildhl/ProgressAnalyser.hpp>
+
+using namespace buildhl;
+
+namespace {
+    /** "complete/total" of line or "none" */
+    std::string progress_of(const std::string& line) {
+        Progress progress = parse_progress(line);
+        if (!progress)
+            return "none";
+        return std::to_string((int)progress.complete) + "/" + std::to_string((int)progress.total);
+    }
+}
+
+TEST(parse_ninja_status) {
+    size_t length = 99;
+    Progress progress = parse_ninja_status("@bhl@3/10/2/1.234@ Building CXX object a.o\n", &length);
+    CHECK_EQ(length, 19u);
+    CHECK_EQ(progress.complete, 3.0);
+    CHECK_EQ(progress.total, 10.0);
+    CHECK_EQ(progress.running, 2);
+    CHECK_EQ(progress.elapsed, 1.234);
+
+    progress = parse_ninja_status("@bhl@0/1/0/0.000@ Re-running CMake...", &length);
+    CHECK_EQ(length, 18u);
+    CHECK_EQ(progress.total, 1.0);
+    CHECK_EQ(progress.elapsed, 0.0);
+}
+
+TEST(parse_ninja_status_rejects) {
+    size_t length = 99;
+    // the users own NINJA_STATUS
+    CHECK(!parse_ninja_status("[3/10] Building CXX object a.o", &length));
+    CHECK_EQ(length, 0u);
+    for (const char* line : {"@bhl@", "@bhl@3/10/2/1.234@", "@bhl@3/10/2/1.234 x", "@bhl@3/10/2@ x",
+            "@bhl@3/10/x/1.0@ x", "@bhl@/10/2/1.0@ x", " @bhl@3/10/2/1.0@ x"}) {
+        length = 99;
+        parse_ninja_status(line, &length);
+        CHECK_EQ(length, 0u);
+    }
+}
+
+TEST(parse_progress) {
+    CHECK_EQ(progress_of("[3/10] Building CXX object src/a.cpp.o"), "3/10");
+    CHECK_EQ(progress_of("[ 12 / 40 ] compiling"), "12/40");
+    CHECK_EQ(progress_of("   Building [=======>      ] 45/120: serde"), "45/120");
+    CHECK_EQ(progress_of("[ 45%] Building C object a.o"), "none");
+    CHECK_EQ(progress_of("no numbers here"), "none");
+    CHECK_EQ(progress_of("a 7/ b"), "none");
+    CHECK_EQ(progress_of("ends with 7 /"), "none");
+    // the first n/m is it, a larger n means it isn't a progress
+    CHECK_EQ(progress_of("10/3 then 1/2"), "none");
+    CHECK_EQ(progress_of("version 2 then 5/9"), "5/9");
+}
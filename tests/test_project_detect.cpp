@@ -0,0 +1,48 @@
+#include "check.hpp"
+
+#include <buildhl/project_detect.hpp>
+
+#include <filesystem>
+#include <fstream>
+
+using namespace buildhl;
+namespace fs = std::filesystem;
+
+namespace {
+    std::string test_project_dir() {
+        fs::path dir = fs::temp_directory_path() / "buildhl_tests_project";
+        fs::remove_all(dir);
+        fs::create_directories(dir);
+        return dir.string();
+    }
+}
+
+TEST(default_build_dir) {
+    std::string project = test_project_dir();
+    InvocationInfo invocation;
+    invocation.build_type = BuildType::debug;
+    CHECK_EQ(default_build_dir(invocation, project), project + "/build/debug");
+    invocation.build_dir = "/elsewhere";
+    CHECK_EQ(default_build_dir(invocation, project), "/elsewhere");
+    fs::remove_all(project);
+}
+
+TEST(default_build_dir_multi_config) {
+    std::string project = test_project_dir();
+    InvocationInfo invocation;
+    invocation.multi_config = true;
+    // a single config generator would build one build type from build/multi
+    invocation.configure_options = {"-GUnix Makefiles"};
+    CHECK_EQ(default_build_dir(invocation, project), project + "/build/release");
+    invocation.configure_options = {"-G", "Ninja Multi-Config"};
+    CHECK_EQ(default_build_dir(invocation, project), project + "/build/multi");
+
+    // the generator of an existing build/multi decides
+    fs::create_directories(project + "/build/multi");
+    std::ofstream(project + "/build/multi/CMakeCache.txt") << "CMAKE_GENERATOR:INTERNAL=Unix Makefiles\n";
+    CHECK_EQ(default_build_dir(invocation, project), project + "/build/release");
+    std::ofstream(project + "/build/multi/CMakeCache.txt") << "CMAKE_GENERATOR:INTERNAL=Ninja Multi-Config\n";
+    invocation.configure_options = {};
+    CHECK_EQ(default_build_dir(invocation, project), project + "/build/multi");
+    fs::remove_all(project);
+}
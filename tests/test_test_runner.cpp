@@ -0,0 +1,86 @@
+#include "check.hpp"
+
+#include <buildhl/test_runner.hpp>
+
+#include <cstring>
+
+using namespace buildhl;
+
+namespace {
+    /** ctest -j2 output of a project with one test of each kind */
+    const char* kCTestOutput =
+        "Test project /tmp/ct_t/b\r\n"
+        "    Start 3: setup\n"
+        "    Start 1: pass\n"
+        "1/8 Test #3: setup ............................***Failed    0.00 sec\n"
+        "2/8 Test #1: pass .............................   Passed    0.01 sec\n"
+        "Failed test dependencies: setup\n"
+        "3/8 Test #4: needs_db .........................***Not Run   0.00 sec\n"
+        "4/8 Test #2: fail .............................***Failed    1.50 sec\n"
+        "5/8 Test #6: disabled .........................***Not Run (Disabled)   0.00 sec\n"
+        "6/8 Test #7: missing ..........................***Not Run   0.00 sec\n"
+        "7/8 Test #8: slow .............................***Timeout  10.02 sec\n"
+        "8/8 Test #5: skip .............................***Skipped   0.00 sec\n"
+        "  8 - slow (Timeout) 0.5 sec\n"
+        "29% tests passed, 5 tests failed out of 7\n";
+
+    std::vector<TestRecord> parse_output() {
+        CTestOutputParser parser;
+        // in pieces, as reads return it
+        size_t size = strlen(kCTestOutput);
+        for (size_t pos = 0; pos < size; pos += 7)
+            parser.feed(kCTestOutput + pos, std::min<size_t>(7, size - pos));
+        return parser.records();
+    }
+}
+
+TEST(ctest_parse_line) {
+    TestRecord record;
+    CHECK(CTestOutputParser::parse_line(
+        "12/120 Test  #12: name.with.dots ...............   Passed    0.52 sec", record));
+    CHECK_EQ(record.name, "name.with.dots");
+    CHECK_EQ(record.status, "Passed");
+    CHECK_EQ(record.seconds, 0.52);
+    CHECK(CTestOutputParser::parse_line(
+        "1/1 Test #1: e ..***Exception: SegFault  0.10 sec", record));
+    CHECK_EQ(record.status, "Exception: SegFault");
+    CHECK(!CTestOutputParser::parse_line("    Start 1: pass", record));
+    CHECK(!CTestOutputParser::parse_line("Total Test time (real) =   0.03 sec", record));
+}
+
+TEST(ctest_output_records) {
+    auto records = parse_output();
+    CHECK_EQ(records.size(), 8u);
+    if (records.size() != 8)
+        return;
+    CHECK_EQ(records[0].name, "setup");
+    CHECK(records[0].failed());
+    CHECK(!records[1].failed());
+    CHECK(records[1].ran());
+    CHECK_EQ(records[2].name, "needs_db");
+    CHECK(records[2].not_run());
+    CHECK(!records[2].failed());
+    CHECK(!records[2].ran());
+    CHECK_EQ(records[4].status, "Not Run (Disabled)");
+    CHECK(records[4].disabled());
+    CHECK(!records[4].failed());
+    CHECK_EQ(records[6].status, "Timeout");
+    CHECK_EQ(records[6].seconds, 10.02);
+    CHECK(records[6].failed());
+    CHECK(!records[7].failed());
+    CHECK(!records[7].ran());
+    CHECK(!records[7].not_run());
+}
+
+TEST(ctest_report) {
+    auto lines = test_report(parse_output());
+    CHECK(lines.size() >= 6u);
+    if (lines.size() < 6)
+        return;
+    CHECK_EQ(lines[0].substr(0, 49), "[tests] 1 passed, 3 failed, 3 not run, 1 skipped,");
+    CHECK_EQ(lines[1], "    Failed setup");
+    CHECK_EQ(lines[2], "    Failed fail");
+    CHECK_EQ(lines[3], "    Timeout slow");
+    CHECK_EQ(lines[4], "    Not Run needs_db");
+    CHECK_EQ(lines[5], "    Not Run missing");
+}